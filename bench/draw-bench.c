@@ -0,0 +1,488 @@
+/*
+ * LavaLauncher - A simple launcher panel for Wayland
+ *
+ * Copyright (C) 2020 - 2021 Leon Henrik Plickat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Times the drawing code of the bar, the indicators and the icons by rendering
+ * into cairo image surfaces, without any Wayland connection.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<string.h>
+#include<errno.h>
+#include<time.h>
+#include<unistd.h>
+#include<stdatomic.h>
+#include<cairo/cairo.h>
+
+#include"lavalauncher.h"
+#include"draw.h"
+#include"types/image_t.h"
+#include"types/colour_t.h"
+#include"types/box_t.h"
+
+/* Every case runs for at least this many frames and this long. */
+#define MIN_FRAMES  20
+#define MIN_TIME_NS 100000000
+
+#define ITEM_SIZE        32
+#define ICON_PADDING     4
+#define BACKGROUND_ITEMS 10
+
+/* Largest width or height of a cairo image surface. */
+#define MAX_SURFACE_SIZE 32767
+
+/* The drawing code is linked in directly, so it needs a context to read its
+ * settings from. With the default zero values logging is quiet and SVG images
+ * are always rendered instead of read from the raster cache.
+ */
+struct Lava_context context;
+
+/*************************
+ *                       *
+ *  Allocation counting  *
+ *                       *
+ *************************/
+/* Counting allocations needs glibc, whose malloc can be wrapped by simply
+ * defining malloc, which also catches the allocations of cairo and librsvg.
+ * Aligned allocations are not counted.
+ */
+#if defined(__GLIBC__)
+#define COUNT_ALLOCATIONS 1
+
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t n, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+
+static atomic_ulong allocations;
+
+void *malloc (size_t size)
+{
+	atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+	return __libc_malloc(size);
+}
+
+void *calloc (size_t n, size_t size)
+{
+	atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+	return __libc_calloc(n, size);
+}
+
+void *realloc (void *ptr, size_t size)
+{
+	atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+	return __libc_realloc(ptr, size);
+}
+
+static unsigned long get_allocations (void)
+{
+	return atomic_load_explicit(&allocations, memory_order_relaxed);
+}
+#else
+#define COUNT_ALLOCATIONS 0
+
+static unsigned long get_allocations (void)
+{
+	return 0;
+}
+#endif
+
+/************
+ *          *
+ *  Runner  *
+ *          *
+ ************/
+typedef void (*frame_func_t)(void *data);
+
+static uint64_t now_ns (void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static void print_header (void)
+{
+	printf("%-12s %-44s %8s %12s %14s\n", "case", "parameters", "frames",
+			"ns/frame", "allocs/frame");
+}
+
+static void run_case (const char *name, const char *parameters,
+		frame_func_t frame, void *data)
+{
+	/* Warm up, so lazily created state is not counted. */
+	frame(data);
+
+	const unsigned long allocations_start = get_allocations();
+	const uint64_t      start             = now_ns();
+	unsigned long       frames            = 0;
+	uint64_t            elapsed;
+	do
+	{
+		frame(data);
+		frames++;
+		elapsed = now_ns() - start;
+	} while ( frames < MIN_FRAMES || elapsed < MIN_TIME_NS );
+
+	const unsigned long allocs = get_allocations() - allocations_start;
+
+	printf("%-12s %-44s %8lu %12.0f", name, parameters, frames,
+			(double)elapsed / (double)frames);
+	if (COUNT_ALLOCATIONS)
+		printf(" %14.2f\n", (double)allocs / (double)frames);
+	else
+		printf(" %14s\n", "n/a");
+}
+
+static void skip_case (const char *name, const char *parameters, const char *reason)
+{
+	printf("%-12s %-44s skipped: %s\n", name, parameters, reason);
+}
+
+static cairo_t *create_image_cairo (uint32_t w, uint32_t h)
+{
+	cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+			(int)w, (int)h);
+	cairo_t *cairo = cairo_create(surface);
+	cairo_surface_destroy(surface);
+	if ( cairo_status(cairo) != CAIRO_STATUS_SUCCESS )
+	{
+		fprintf(stderr, "ERROR: Can not create %ux%u image surface: %s\n", w, h,
+				cairo_status_to_string(cairo_status(cairo)));
+		cairo_destroy(cairo);
+		return NULL;
+	}
+	return cairo;
+}
+
+/*****************
+ *               *
+ *  Test images  *
+ *               *
+ *****************/
+static const char svg_icon[] =
+	"<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"64\" height=\"64\" viewBox=\"0 0 64 64\">\n"
+	"  <circle cx=\"32\" cy=\"32\" r=\"28\" fill=\"#d08770\" stroke=\"#2e3440\" stroke-width=\"3\"/>\n"
+	"  <rect x=\"18\" y=\"18\" width=\"28\" height=\"28\" rx=\"6\" fill=\"#88c0d0\"/>\n"
+	"  <path d=\"M20 44 L32 22 L44 44 Z\" fill=\"#a3be8c\" opacity=\"0.8\"/>\n"
+	"</svg>\n";
+
+static char image_dir[] = "/tmp/lavalauncher-draw-bench-XXXXXX";
+static char png_path[sizeof(image_dir) + 16], svg_path[sizeof(image_dir) + 16];
+
+static bool write_png_icon (void)
+{
+	cairo_t *cairo = create_image_cairo(64, 64);
+	if ( cairo == NULL )
+		return false;
+
+	cairo_arc(cairo, 32, 32, 28, 0, 2 * 3.1415927);
+	cairo_set_source_rgba(cairo, 0.82, 0.53, 0.44, 1.0);
+	cairo_fill(cairo);
+	cairo_rectangle(cairo, 18, 18, 28, 28);
+	cairo_set_source_rgba(cairo, 0.53, 0.75, 0.82, 1.0);
+	cairo_fill(cairo);
+
+	const bool ret = cairo_surface_write_to_png(cairo_get_target(cairo),
+			png_path) == CAIRO_STATUS_SUCCESS;
+	cairo_destroy(cairo);
+	return ret;
+}
+
+static bool write_svg_icon (void)
+{
+	FILE *file = fopen(svg_path, "w");
+	if ( file == NULL )
+		return false;
+	fputs(svg_icon, file);
+	fclose(file);
+	return true;
+}
+
+static bool create_test_images (void)
+{
+	if ( mkdtemp(image_dir) == NULL )
+	{
+		fprintf(stderr, "ERROR: mkdtemp: %s\n", strerror(errno));
+		return false;
+	}
+	snprintf(png_path, sizeof(png_path), "%s/icon.png", image_dir);
+	snprintf(svg_path, sizeof(svg_path), "%s/icon.svg", image_dir);
+
+	if ( ! write_png_icon() || ! write_svg_icon() )
+	{
+		fprintf(stderr, "ERROR: Can not write test images to %s.\n", image_dir);
+		return false;
+	}
+	return true;
+}
+
+static void remove_test_images (void)
+{
+	unlink(png_path);
+	unlink(svg_path);
+	rmdir(image_dir);
+}
+
+/****************
+ *              *
+ *  Background  *
+ *              *
+ ****************/
+struct Background_case
+{
+	cairo_t       *cairo;
+	ubox_t         dim;
+	udirections_t  border;
+	uradii_t       radii;
+	uint32_t       scale;
+	colour_t       bar_colour, border_colour;
+};
+
+static void background_frame (void *data)
+{
+	struct Background_case *c = (struct Background_case *)data;
+	clear_buffer(c->cairo);
+	draw_bar_background(c->cairo, &c->dim, &c->border, &c->radii, c->scale,
+			&c->bar_colour, &c->border_colour);
+}
+
+static void bench_background (void)
+{
+	const uint32_t shapes[][2] = {
+		/* Border, radius. */
+		{ 0, 0 },
+		{ 2, 0 },
+		{ 0, 8 },
+		{ 2, 8 },
+	};
+
+	for (uint32_t scale = 1; scale <= 3; scale++)
+	for (int horizontal = 1; horizontal >= 0; horizontal--)
+	FOR_ARRAY(shapes, i)
+	{
+		struct Background_case c = {
+			.scale         = scale,
+			.bar_colour    = { 0.125, 0.125, 0.125, 1.0 },
+			.border_colour = { 1.0, 1.0, 1.0, 1.0 },
+		};
+		udirections_t_set_all(&c.border, shapes[i][0]);
+		uradii_t_set_all(&c.radii, shapes[i][1]);
+
+		const uint32_t length = BACKGROUND_ITEMS * ITEM_SIZE + 2 * shapes[i][0];
+		const uint32_t depth  = ITEM_SIZE + 2 * shapes[i][0];
+		c.dim = (ubox_t){
+			.x = 0,
+			.y = 0,
+			.w = horizontal ? length : depth,
+			.h = horizontal ? depth : length
+		};
+
+		char parameters[64];
+		snprintf(parameters, sizeof(parameters), "scale=%u %s border=%u radius=%u",
+				scale, horizontal ? "horizontal" : "vertical",
+				shapes[i][0], shapes[i][1]);
+
+		if ( NULL == (c.cairo = create_image_cairo(c.dim.w * scale, c.dim.h * scale)) )
+			continue;
+		run_case("background", parameters, background_frame, &c);
+		cairo_destroy(c.cairo);
+	}
+}
+
+/****************
+ *              *
+ *  Indicators  *
+ *              *
+ ****************/
+struct Indicator_case
+{
+	cairo_t                   *cairo;
+	enum Item_indicator_style  style;
+	uint32_t                   size;
+	uradii_t                   radii;
+	colour_t                   colour;
+};
+
+static void indicator_frame (void *data)
+{
+	struct Indicator_case *c = (struct Indicator_case *)data;
+	draw_indicator(c->cairo, c->style, c->size, &c->radii, &c->colour);
+}
+
+static void bench_indicators (void)
+{
+	const struct
+	{
+		enum Item_indicator_style style;
+		const char *name;
+	} styles[] = {
+		{ STYLE_RECTANGLE,         "rectangle"         },
+		{ STYLE_ROUNDED_RECTANGLE, "rounded-rectangle" },
+		{ STYLE_CIRCLE,            "circle"            },
+	};
+
+	for (uint32_t scale = 1; scale <= 3; scale++)
+	FOR_ARRAY(styles, i)
+	{
+		struct Indicator_case c = {
+			.style  = styles[i].style,
+			.size   = ITEM_SIZE * scale,
+			.colour = { 0.25, 0.25, 0.25, 1.0 },
+		};
+		uradii_t_set_all(&c.radii, 8 * scale);
+
+		char parameters[64];
+		snprintf(parameters, sizeof(parameters), "scale=%u style=%s",
+				scale, styles[i].name);
+
+		if ( NULL == (c.cairo = create_image_cairo(c.size, c.size)) )
+			continue;
+		run_case("indicator", parameters, indicator_frame, &c);
+		cairo_destroy(c.cairo);
+	}
+}
+
+/***********
+ *         *
+ *  Icons  *
+ *         *
+ ***********/
+struct Icon_case
+{
+	cairo_t  *cairo;
+	image_t  *image;
+	uint32_t  cell;
+};
+
+/* Rasterizing an image into the icon atlas. */
+static void icon_frame (void *data)
+{
+	struct Icon_case *c = (struct Icon_case *)data;
+	clear_buffer(c->cairo);
+	image_t_draw_to_cairo(c->cairo, c->image, 0, 0, c->cell, c->cell);
+}
+
+struct Items_case
+{
+	cairo_t         *cairo;
+	cairo_surface_t *atlas;
+	uint32_t         cell, length, depth, amount;
+	bool             horizontal;
+};
+
+/* Redrawing every item of the icon surface from the atlas. */
+static void items_frame (void *data)
+{
+	struct Items_case *c = (struct Items_case *)data;
+	for (uint32_t i = 0; i < c->amount; i++)
+	{
+		ubox_t box = c->horizontal
+			? (ubox_t){ .x = i * c->length, .y = 0, .w = c->length, .h = c->depth }
+			: (ubox_t){ .x = 0, .y = i * c->length, .w = c->depth, .h = c->length };
+		draw_item_icon(c->cairo, &box, c->atlas, 0, 0, c->cell, ICON_PADDING);
+	}
+}
+
+static void bench_icons (const char *type, const char *path)
+{
+	const uint32_t amounts[] = { 10, 50, 100, 500 };
+
+	image_t *image = image_t_create_from_file(path);
+	if ( image == NULL )
+	{
+		fprintf(stderr, "ERROR: Can not load %s test image.\n", type);
+		return;
+	}
+
+	for (uint32_t scale = 1; scale <= 3; scale++)
+	{
+		char parameters[64];
+		struct Icon_case icon = {
+			.image = image,
+			.cell  = ITEM_SIZE * scale - 2 * ICON_PADDING,
+		};
+
+		if ( NULL == (icon.cairo = create_image_cairo(icon.cell, icon.cell)) )
+			continue;
+		snprintf(parameters, sizeof(parameters), "scale=%u icon=%s", scale, type);
+		run_case("icon", parameters, icon_frame, &icon);
+
+		/* The rasterized icon doubles as a one slot atlas. */
+		cairo_surface_t *atlas = cairo_get_target(icon.cairo);
+
+		for (int horizontal = 1; horizontal >= 0; horizontal--)
+		FOR_ARRAY(amounts, i)
+		{
+			struct Items_case items = {
+				.atlas      = atlas,
+				.cell       = icon.cell,
+				.length     = ITEM_SIZE * scale,
+				.depth      = ITEM_SIZE * scale,
+				.amount     = amounts[i],
+				.horizontal = horizontal,
+			};
+
+			snprintf(parameters, sizeof(parameters), "scale=%u %s items=%u icon=%s",
+					scale, horizontal ? "horizontal" : "vertical",
+					amounts[i], type);
+
+			const uint32_t total = items.length * items.amount;
+			if ( total > MAX_SURFACE_SIZE )
+			{
+				skip_case("items", parameters, "surface too large for cairo");
+				continue;
+			}
+
+			items.cairo = horizontal ? create_image_cairo(total, items.depth)
+				: create_image_cairo(items.depth, total);
+			if ( items.cairo == NULL )
+				continue;
+			run_case("items", parameters, items_frame, &items);
+			cairo_destroy(items.cairo);
+		}
+
+		cairo_destroy(icon.cairo);
+	}
+
+	image_t_destroy(image);
+}
+
+int main (void)
+{
+	if (! create_test_images())
+		return EXIT_FAILURE;
+
+	print_header();
+	bench_background();
+	bench_indicators();
+	bench_icons("png", png_path);
+#if SVG_SUPPORT
+	bench_icons("svg", svg_path);
+#else
+	skip_case("icon", "icon=svg", "built without SVG support");
+#endif
+
+	image_t_cache_finish();
+	remove_test_images();
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,1342 @@
+/*
+ * LavaLauncher - A simple launcher panel for Wayland
+ *
+ * Copyright (C) 2020 - 2021 Leon Henrik Plickat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* A minimal headless compositor, just complete enough to run LavaLauncher.
+ * It spawns lavalauncher, drives it through a scripted set of interactions
+ * and reports how much work each of them caused on the protocol level.
+ *
+ * Usage: mock-compositor /path/to/lavalauncher
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<string.h>
+#include<errno.h>
+#include<signal.h>
+#include<time.h>
+#include<unistd.h>
+#include<sys/types.h>
+#include<sys/wait.h>
+
+#include<wayland-server.h>
+#include"wlr-layer-shell-unstable-v1-server-protocol.h"
+#include"xdg-output-unstable-v1-server-protocol.h"
+
+/* How long the client has to be silent for an interaction to be complete. */
+#define IDLE_TIMEOUT_MS 100
+
+/* Upper bound for the whole run, in case the client hangs or crashes. */
+#define RUN_TIMEOUT_MS 30000
+
+/* Frame callbacks are done at the refresh rate of the mock output. */
+#define FRAME_INTERVAL_MS 16
+
+#define OUTPUT_WIDTH  1920
+#define OUTPUT_HEIGHT 1080
+
+#define BAR_SIZE    40
+#define BAR_BUTTONS 12
+
+#define CLICKS 20
+
+/* Scale changes while the mock holds every buffer; More than any swapchain
+ * of LavaLauncher has buffers.
+ */
+#define HELD_SCALE_CHANGES 16
+
+static const char config_template[] =
+	"bar\n"
+	"{\n"
+	"\tposition          = bottom;\n"
+	"\tsize              = %d;\n"
+	"\tborder            = 2;\n"
+	"\tradius            = 5;\n"
+	"\tbackground-colour = \"#202020\";\n"
+	"\tborder-colour     = \"#ffffff\";\n"
+	"\tcursor-name       = pointer;\n"
+	"%s"
+	"}\n";
+
+static const char button_config[] =
+	"\tbutton\n"
+	"\t{\n"
+	"\t\tcommand = true;\n"
+	"\t}\n";
+
+enum Phase
+{
+	PHASE_STARTUP,
+	PHASE_POINTER_SWEEP,
+	PHASE_CLICKS,
+	PHASE_HOTPLUG,
+	PHASE_HELD_BUFFERS,
+	PHASE_DONE
+};
+
+static const char *phase_names[] = {
+	[PHASE_STARTUP]       = "startup",
+	[PHASE_POINTER_SWEEP] = "pointer-sweep",
+	[PHASE_CLICKS]        = "clicks",
+	[PHASE_HOTPLUG]       = "output-hotplug",
+	[PHASE_HELD_BUFFERS]  = "held-buffers",
+};
+
+struct Phase_stats
+{
+	unsigned long interactions;
+	unsigned long requests;
+	unsigned long events;
+	unsigned long commits;
+	unsigned long long shm_bytes;
+	double time_to_commit_ms;
+};
+
+struct Mock_output
+{
+	struct wl_global   *global;
+	struct wl_resource *resource;
+	const char         *name;
+};
+
+/* A replaced buffer the mock does not release yet. */
+struct Held_buffer
+{
+	struct wl_list      link;
+	struct wl_resource *buffer;
+	struct wl_listener  destroy;
+};
+
+struct Mock_surface
+{
+	struct wl_resource *resource;
+
+	/* Attached, but not yet committed. */
+	bool                pending_attach;
+	struct wl_resource *pending_buffer;
+	struct wl_listener  pending_buffer_destroy;
+	struct wl_list      frame_callbacks;
+
+	/* Committed, held until replaced by the next commit. */
+	struct wl_resource *current_buffer;
+	struct wl_listener  current_buffer_destroy;
+
+	struct Mock_layer_surface *layer_surface;
+};
+
+struct Mock_layer_surface
+{
+	struct wl_resource  *resource;
+	struct Mock_surface *surface;
+
+	uint32_t w, h, configured_w, configured_h;
+	bool     configured;
+};
+
+/* Sizes of the shm pools, indexed by object id, to account for resizes. */
+struct Pool_size
+{
+	uint32_t id;
+	int32_t  size;
+};
+
+static struct
+{
+	struct wl_display    *display;
+	struct wl_event_loop *loop;
+	struct wl_event_source *idle_timer, *run_timer, *frame_timer;
+
+	/* Committed frame callbacks of all surfaces and whether the frame
+	 * timer is armed to send them.
+	 */
+	struct wl_list frame_callbacks;
+	bool           frame_scheduled;
+
+	/* Replaced buffers are held instead of released while set. */
+	bool           hold_buffers;
+	struct wl_list held_buffers;
+	int            scale, scale_changes;
+
+	struct Mock_output outputs[2];
+
+	struct wl_resource  *pointer;
+	struct Mock_layer_surface *layer_surface;
+
+	struct Pool_size *pools;
+	size_t            pool_amount;
+
+	pid_t  child;
+	char  *runtime_dir;
+	char  *config_path;
+	bool   own_runtime_dir;
+
+	enum Phase         phase;
+	struct timespec    phase_start;
+	bool               phase_committed;
+	struct Phase_stats stats[PHASE_DONE];
+
+	int ret;
+} mock;
+
+static struct timespec now (void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts;
+}
+
+static double ms_since (struct timespec *start)
+{
+	struct timespec ts = now();
+	return (double)(ts.tv_sec - start->tv_sec) * 1000.0
+		+ (double)(ts.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+static uint32_t time_ms (void)
+{
+	struct timespec ts = now();
+	return (uint32_t)((uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000);
+}
+
+static void resource_destroy (struct wl_client *client, struct wl_resource *resource)
+{
+	wl_resource_destroy(resource);
+}
+
+/*************
+ *           *
+ *  Regions  *
+ *           *
+ *************/
+static void region_noop (struct wl_client *client, struct wl_resource *resource,
+		int32_t x, int32_t y, int32_t w, int32_t h)
+{
+}
+
+static const struct wl_region_interface region_implementation = {
+	.destroy  = resource_destroy,
+	.add      = region_noop,
+	.subtract = region_noop
+};
+
+/**************
+ *            *
+ *  Surfaces  *
+ *            *
+ **************/
+static void surface_pending_buffer_handle_destroy (struct wl_listener *listener, void *data)
+{
+	struct Mock_surface *surface = wl_container_of(listener, surface, pending_buffer_destroy);
+	wl_list_remove(&surface->pending_buffer_destroy.link);
+	wl_list_init(&surface->pending_buffer_destroy.link);
+	surface->pending_buffer = NULL;
+}
+
+static void surface_current_buffer_handle_destroy (struct wl_listener *listener, void *data)
+{
+	struct Mock_surface *surface = wl_container_of(listener, surface, current_buffer_destroy);
+	wl_list_remove(&surface->current_buffer_destroy.link);
+	wl_list_init(&surface->current_buffer_destroy.link);
+	surface->current_buffer = NULL;
+}
+
+static void surface_attach (struct wl_client *client, struct wl_resource *resource,
+		struct wl_resource *buffer, int32_t x, int32_t y)
+{
+	struct Mock_surface *surface = wl_resource_get_user_data(resource);
+	wl_list_remove(&surface->pending_buffer_destroy.link);
+	wl_list_init(&surface->pending_buffer_destroy.link);
+	surface->pending_attach = true;
+	surface->pending_buffer = buffer;
+	if ( buffer != NULL )
+		wl_resource_add_destroy_listener(buffer, &surface->pending_buffer_destroy);
+}
+
+static void surface_damage (struct wl_client *client, struct wl_resource *resource,
+		int32_t x, int32_t y, int32_t w, int32_t h)
+{
+}
+
+static void callback_handle_resource_destroy (struct wl_resource *resource)
+{
+	wl_list_remove(wl_resource_get_link(resource));
+}
+
+static void surface_frame (struct wl_client *client, struct wl_resource *resource,
+		uint32_t id)
+{
+	struct Mock_surface *surface = wl_resource_get_user_data(resource);
+	struct wl_resource *callback = wl_resource_create(client, &wl_callback_interface, 1, id);
+	if ( callback == NULL )
+	{
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(callback, NULL, NULL, callback_handle_resource_destroy);
+	wl_list_insert(surface->frame_callbacks.prev, wl_resource_get_link(callback));
+}
+
+static void surface_set_region (struct wl_client *client, struct wl_resource *resource,
+		struct wl_resource *region)
+{
+}
+
+static void phase_commit (void);
+static void phase_commit_done (void);
+
+static void layer_surface_configure (struct Mock_layer_surface *layer_surface)
+{
+	uint32_t w = layer_surface->w == 0 ? OUTPUT_WIDTH : layer_surface->w;
+	uint32_t h = layer_surface->h == 0 ? OUTPUT_HEIGHT : layer_surface->h;
+	if ( layer_surface->configured && layer_surface->configured_w == w
+			&& layer_surface->configured_h == h )
+		return;
+
+	layer_surface->configured   = true;
+	layer_surface->configured_w = w;
+	layer_surface->configured_h = h;
+	zwlr_layer_surface_v1_send_configure(layer_surface->resource,
+			wl_display_next_serial(mock.display), w, h);
+}
+
+static void held_buffer_free (struct Held_buffer *held)
+{
+	wl_list_remove(&held->link);
+	wl_list_remove(&held->destroy.link);
+	free(held);
+}
+
+static void held_buffer_handle_destroy (struct wl_listener *listener, void *data)
+{
+	struct Held_buffer *held = wl_container_of(listener, held, destroy);
+	held_buffer_free(held);
+}
+
+/* Release a buffer replaced by a commit, unless buffers are held. */
+static void release_buffer (struct wl_resource *buffer)
+{
+	if (! mock.hold_buffers)
+	{
+		wl_buffer_send_release(buffer);
+		return;
+	}
+
+	struct Held_buffer *held = calloc(1, sizeof(struct Held_buffer));
+	if ( held == NULL )
+	{
+		wl_buffer_send_release(buffer);
+		return;
+	}
+	held->buffer         = buffer;
+	held->destroy.notify = held_buffer_handle_destroy;
+	wl_resource_add_destroy_listener(buffer, &held->destroy);
+	wl_list_insert(&mock.held_buffers, &held->link);
+}
+
+static void release_held_buffers (void)
+{
+	mock.hold_buffers = false;
+	struct Held_buffer *held, *tmp;
+	wl_list_for_each_safe(held, tmp, &mock.held_buffers, link)
+	{
+		wl_buffer_send_release(held->buffer);
+		held_buffer_free(held);
+	}
+}
+
+static int handle_frame_timer (void *data)
+{
+	mock.frame_scheduled = false;
+
+	const uint32_t time = time_ms();
+	struct wl_resource *callback, *tmp;
+	wl_resource_for_each_safe(callback, tmp, &mock.frame_callbacks)
+	{
+		wl_callback_send_done(callback, time);
+		wl_resource_destroy(callback);
+	}
+	return 0;
+}
+
+/* Like a real compositor, the mock holds the committed buffer until the next
+ * commit replaces it and does frame callbacks once per refresh of the output.
+ */
+static void surface_commit (struct wl_client *client, struct wl_resource *resource)
+{
+	struct Mock_surface *surface = wl_resource_get_user_data(resource);
+
+	if (surface->pending_attach)
+	{
+		if ( surface->current_buffer != NULL
+				&& surface->current_buffer != surface->pending_buffer )
+			release_buffer(surface->current_buffer);
+
+		wl_list_remove(&surface->current_buffer_destroy.link);
+		wl_list_init(&surface->current_buffer_destroy.link);
+		surface->current_buffer = surface->pending_buffer;
+		if ( surface->current_buffer != NULL )
+			wl_resource_add_destroy_listener(surface->current_buffer,
+					&surface->current_buffer_destroy);
+
+		wl_list_remove(&surface->pending_buffer_destroy.link);
+		wl_list_init(&surface->pending_buffer_destroy.link);
+		surface->pending_buffer = NULL;
+		surface->pending_attach = false;
+
+		if ( surface->current_buffer != NULL && surface->layer_surface != NULL
+				&& surface->layer_surface->configured )
+		{
+			phase_commit();
+			phase_commit_done();
+		}
+	}
+
+	if ( surface->layer_surface != NULL )
+		layer_surface_configure(surface->layer_surface);
+
+	if (! wl_list_empty(&surface->frame_callbacks))
+	{
+		wl_list_insert_list(mock.frame_callbacks.prev, &surface->frame_callbacks);
+		wl_list_init(&surface->frame_callbacks);
+		if (! mock.frame_scheduled)
+		{
+			wl_event_source_timer_update(mock.frame_timer, FRAME_INTERVAL_MS);
+			mock.frame_scheduled = true;
+		}
+	}
+}
+
+static void surface_set_buffer_int (struct wl_client *client, struct wl_resource *resource,
+		int32_t value)
+{
+}
+
+static const struct wl_surface_interface surface_implementation = {
+	.destroy              = resource_destroy,
+	.attach               = surface_attach,
+	.damage               = surface_damage,
+	.frame                = surface_frame,
+	.set_opaque_region    = surface_set_region,
+	.set_input_region     = surface_set_region,
+	.commit               = surface_commit,
+	.set_buffer_transform = surface_set_buffer_int,
+	.set_buffer_scale     = surface_set_buffer_int,
+	.damage_buffer        = surface_damage
+};
+
+static void surface_handle_resource_destroy (struct wl_resource *resource)
+{
+	struct Mock_surface *surface = wl_resource_get_user_data(resource);
+
+	struct wl_resource *callback, *tmp;
+	wl_resource_for_each_safe(callback, tmp, &surface->frame_callbacks)
+		wl_resource_destroy(callback);
+
+	wl_list_remove(&surface->pending_buffer_destroy.link);
+	wl_list_remove(&surface->current_buffer_destroy.link);
+	if ( surface->layer_surface != NULL )
+		surface->layer_surface->surface = NULL;
+	free(surface);
+}
+
+static void compositor_create_surface (struct wl_client *client,
+		struct wl_resource *resource, uint32_t id)
+{
+	struct Mock_surface *surface = calloc(1, sizeof(struct Mock_surface));
+	if ( surface == NULL )
+	{
+		wl_client_post_no_memory(client);
+		return;
+	}
+
+	surface->resource = wl_resource_create(client, &wl_surface_interface,
+			wl_resource_get_version(resource), id);
+	if ( surface->resource == NULL )
+	{
+		free(surface);
+		wl_client_post_no_memory(client);
+		return;
+	}
+
+	wl_list_init(&surface->frame_callbacks);
+	wl_list_init(&surface->pending_buffer_destroy.link);
+	wl_list_init(&surface->current_buffer_destroy.link);
+	surface->pending_buffer_destroy.notify = surface_pending_buffer_handle_destroy;
+	surface->current_buffer_destroy.notify = surface_current_buffer_handle_destroy;
+
+	wl_resource_set_implementation(surface->resource, &surface_implementation,
+			surface, surface_handle_resource_destroy);
+}
+
+static void compositor_create_region (struct wl_client *client,
+		struct wl_resource *resource, uint32_t id)
+{
+	struct wl_resource *region = wl_resource_create(client, &wl_region_interface, 1, id);
+	if ( region == NULL )
+	{
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(region, &region_implementation, NULL, NULL);
+}
+
+static const struct wl_compositor_interface compositor_implementation = {
+	.create_surface = compositor_create_surface,
+	.create_region  = compositor_create_region
+};
+
+static void compositor_bind (struct wl_client *client, void *data,
+		uint32_t version, uint32_t id)
+{
+	struct wl_resource *resource = wl_resource_create(client,
+			&wl_compositor_interface, (int)version, id);
+	if ( resource == NULL )
+	{
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(resource, &compositor_implementation, NULL, NULL);
+}
+
+/*****************
+ *               *
+ *  Subsurfaces  *
+ *               *
+ *****************/
+static void subsurface_set_position (struct wl_client *client, struct wl_resource *resource,
+		int32_t x, int32_t y)
+{
+}
+
+static void subsurface_place (struct wl_client *client, struct wl_resource *resource,
+		struct wl_resource *sibling)
+{
+}
+
+static void subsurface_set_mode (struct wl_client *client, struct wl_resource *resource)
+{
+}
+
+static const struct wl_subsurface_interface subsurface_implementation = {
+	.destroy      = resource_destroy,
+	.set_position = subsurface_set_position,
+	.place_above  = subsurface_place,
+	.place_below  = subsurface_place,
+	.set_sync     = subsurface_set_mode,
+	.set_desync   = subsurface_set_mode
+};
+
+static void subcompositor_get_subsurface (struct wl_client *client,
+		struct wl_resource *resource, uint32_t id,
+		struct wl_resource *surface, struct wl_resource *parent)
+{
+	struct wl_resource *subsurface = wl_resource_create(client,
+			&wl_subsurface_interface, 1, id);
+	if ( subsurface == NULL )
+	{
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(subsurface, &subsurface_implementation, NULL, NULL);
+}
+
+static const struct wl_subcompositor_interface subcompositor_implementation = {
+	.destroy        = resource_destroy,
+	.get_subsurface = subcompositor_get_subsurface
+};
+
+static void subcompositor_bind (struct wl_client *client, void *data,
+		uint32_t version, uint32_t id)
+{
+	struct wl_resource *resource = wl_resource_create(client,
+			&wl_subcompositor_interface, (int)version, id);
+	if ( resource == NULL )
+	{
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(resource, &subcompositor_implementation, NULL, NULL);
+}
+
+/*****************
+ *               *
+ *  Layer shell  *
+ *               *
+ *****************/
+static void layer_surface_set_size (struct wl_client *client, struct wl_resource *resource,
+		uint32_t w, uint32_t h)
+{
+	struct Mock_layer_surface *layer_surface = wl_resource_get_user_data(resource);
+	layer_surface->w = w;
+	layer_surface->h = h;
+}
+
+static void layer_surface_set_uint (struct wl_client *client, struct wl_resource *resource,
+		uint32_t value)
+{
+}
+
+static void layer_surface_set_exclusive_zone (struct wl_client *client,
+		struct wl_resource *resource, int32_t zone)
+{
+}
+
+static void layer_surface_set_margin (struct wl_client *client, struct wl_resource *resource,
+		int32_t top, int32_t right, int32_t bottom, int32_t left)
+{
+}
+
+static void layer_surface_get_popup (struct wl_client *client, struct wl_resource *resource,
+		struct wl_resource *popup)
+{
+}
+
+static const struct zwlr_layer_surface_v1_interface layer_surface_implementation = {
+	.set_size                   = layer_surface_set_size,
+	.set_anchor                 = layer_surface_set_uint,
+	.set_exclusive_zone         = layer_surface_set_exclusive_zone,
+	.set_margin                 = layer_surface_set_margin,
+	.set_keyboard_interactivity = layer_surface_set_uint,
+	.get_popup                  = layer_surface_get_popup,
+	.ack_configure              = layer_surface_set_uint,
+	.destroy                    = resource_destroy,
+	.set_layer                  = layer_surface_set_uint
+};
+
+static void layer_surface_handle_resource_destroy (struct wl_resource *resource)
+{
+	struct Mock_layer_surface *layer_surface = wl_resource_get_user_data(resource);
+	if ( layer_surface->surface != NULL )
+		layer_surface->surface->layer_surface = NULL;
+	if ( mock.layer_surface == layer_surface )
+		mock.layer_surface = NULL;
+	free(layer_surface);
+}
+
+static void layer_shell_get_layer_surface (struct wl_client *client,
+		struct wl_resource *resource, uint32_t id,
+		struct wl_resource *surface_resource, struct wl_resource *output,
+		uint32_t layer, const char *namespace)
+{
+	struct Mock_layer_surface *layer_surface = calloc(1, sizeof(struct Mock_layer_surface));
+	if ( layer_surface == NULL )
+	{
+		wl_client_post_no_memory(client);
+		return;
+	}
+
+	layer_surface->resource = wl_resource_create(client, &zwlr_layer_surface_v1_interface,
+			wl_resource_get_version(resource), id);
+	if ( layer_surface->resource == NULL )
+	{
+		free(layer_surface);
+		wl_client_post_no_memory(client);
+		return;
+	}
+
+	layer_surface->surface = wl_resource_get_user_data(surface_resource);
+	layer_surface->surface->layer_surface = layer_surface;
+	wl_resource_set_implementation(layer_surface->resource, &layer_surface_implementation,
+			layer_surface, layer_surface_handle_resource_destroy);
+
+	/* The scripted interactions target the most recently created bar. */
+	mock.layer_surface = layer_surface;
+}
+
+static const struct zwlr_layer_shell_v1_interface layer_shell_implementation = {
+	.get_layer_surface = layer_shell_get_layer_surface,
+	.destroy           = resource_destroy
+};
+
+static void layer_shell_bind (struct wl_client *client, void *data,
+		uint32_t version, uint32_t id)
+{
+	struct wl_resource *resource = wl_resource_create(client,
+			&zwlr_layer_shell_v1_interface, (int)version, id);
+	if ( resource == NULL )
+	{
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(resource, &layer_shell_implementation, NULL, NULL);
+}
+
+/*************
+ *           *
+ *  Outputs  *
+ *           *
+ *************/
+static const struct wl_output_interface output_implementation = {
+	.release = resource_destroy
+};
+
+static void output_handle_resource_destroy (struct wl_resource *resource)
+{
+	struct Mock_output *output = wl_resource_get_user_data(resource);
+	if ( output->resource == resource )
+		output->resource = NULL;
+}
+
+static void output_bind (struct wl_client *client, void *data,
+		uint32_t version, uint32_t id)
+{
+	struct wl_resource *resource = wl_resource_create(client,
+			&wl_output_interface, (int)version, id);
+	if ( resource == NULL )
+	{
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(resource, &output_implementation, data,
+			output_handle_resource_destroy);
+	((struct Mock_output *)data)->resource = resource;
+
+	wl_output_send_geometry(resource, 0, 0, 600, 340, WL_OUTPUT_SUBPIXEL_UNKNOWN,
+			"LavaLauncher", "Mock", WL_OUTPUT_TRANSFORM_NORMAL);
+	wl_output_send_mode(resource, WL_OUTPUT_MODE_CURRENT | WL_OUTPUT_MODE_PREFERRED,
+			OUTPUT_WIDTH, OUTPUT_HEIGHT, 60000);
+	if ( version >= WL_OUTPUT_SCALE_SINCE_VERSION )
+		wl_output_send_scale(resource, 1);
+	if ( version >= WL_OUTPUT_DONE_SINCE_VERSION )
+		wl_output_send_done(resource);
+}
+
+static const struct zxdg_output_v1_interface xdg_output_implementation = {
+	.destroy = resource_destroy
+};
+
+static void xdg_output_manager_get_xdg_output (struct wl_client *client,
+		struct wl_resource *resource, uint32_t id, struct wl_resource *output_resource)
+{
+	struct wl_resource *xdg_output = wl_resource_create(client, &zxdg_output_v1_interface,
+			wl_resource_get_version(resource), id);
+	if ( xdg_output == NULL )
+	{
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(xdg_output, &xdg_output_implementation, NULL, NULL);
+
+	struct Mock_output *output = wl_resource_get_user_data(output_resource);
+	zxdg_output_v1_send_logical_position(xdg_output, 0, 0);
+	zxdg_output_v1_send_logical_size(xdg_output, OUTPUT_WIDTH, OUTPUT_HEIGHT);
+	if ( wl_resource_get_version(xdg_output) >= ZXDG_OUTPUT_V1_NAME_SINCE_VERSION )
+		zxdg_output_v1_send_name(xdg_output, output->name);
+
+	/* Since version 3, xdg_output changes are completed by wl_output.done. */
+	if ( wl_resource_get_version(xdg_output) >= 3 )
+		wl_output_send_done(output_resource);
+	else
+		zxdg_output_v1_send_done(xdg_output);
+}
+
+static const struct zxdg_output_manager_v1_interface xdg_output_manager_implementation = {
+	.destroy        = resource_destroy,
+	.get_xdg_output = xdg_output_manager_get_xdg_output
+};
+
+static void xdg_output_manager_bind (struct wl_client *client, void *data,
+		uint32_t version, uint32_t id)
+{
+	struct wl_resource *resource = wl_resource_create(client,
+			&zxdg_output_manager_v1_interface, (int)version, id);
+	if ( resource == NULL )
+	{
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(resource, &xdg_output_manager_implementation, NULL, NULL);
+}
+
+static bool create_output (struct Mock_output *output, const char *name)
+{
+	output->name   = name;
+	output->global = wl_global_create(mock.display, &wl_output_interface, 3,
+			output, output_bind);
+	return output->global != NULL;
+}
+
+/**********
+ *        *
+ *  Seat  *
+ *        *
+ **********/
+static void pointer_set_cursor (struct wl_client *client, struct wl_resource *resource,
+		uint32_t serial, struct wl_resource *surface, int32_t x, int32_t y)
+{
+}
+
+static const struct wl_pointer_interface pointer_implementation = {
+	.set_cursor = pointer_set_cursor,
+	.release    = resource_destroy
+};
+
+static void pointer_handle_resource_destroy (struct wl_resource *resource)
+{
+	if ( mock.pointer == resource )
+		mock.pointer = NULL;
+}
+
+static void seat_get_pointer (struct wl_client *client, struct wl_resource *resource,
+		uint32_t id)
+{
+	struct wl_resource *pointer = wl_resource_create(client, &wl_pointer_interface,
+			wl_resource_get_version(resource), id);
+	if ( pointer == NULL )
+	{
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(pointer, &pointer_implementation, NULL,
+			pointer_handle_resource_destroy);
+	mock.pointer = pointer;
+}
+
+/* The seat only advertises a pointer, but a client may still ask for the other
+ * devices. They simply never send any events.
+ */
+static const struct wl_keyboard_interface keyboard_implementation = {
+	.release = resource_destroy
+};
+
+static const struct wl_touch_interface touch_implementation = {
+	.release = resource_destroy
+};
+
+static void seat_get_inert_device (struct wl_client *client, struct wl_resource *resource,
+		uint32_t id, const struct wl_interface *interface, const void *implementation)
+{
+	struct wl_resource *device = wl_resource_create(client, interface,
+			wl_resource_get_version(resource), id);
+	if ( device == NULL )
+	{
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(device, implementation, NULL, NULL);
+}
+
+static void seat_get_keyboard (struct wl_client *client, struct wl_resource *resource,
+		uint32_t id)
+{
+	seat_get_inert_device(client, resource, id, &wl_keyboard_interface,
+			&keyboard_implementation);
+}
+
+static void seat_get_touch (struct wl_client *client, struct wl_resource *resource,
+		uint32_t id)
+{
+	seat_get_inert_device(client, resource, id, &wl_touch_interface,
+			&touch_implementation);
+}
+
+static const struct wl_seat_interface seat_implementation = {
+	.get_pointer  = seat_get_pointer,
+	.get_keyboard = seat_get_keyboard,
+	.get_touch    = seat_get_touch,
+	.release      = resource_destroy
+};
+
+static void seat_bind (struct wl_client *client, void *data,
+		uint32_t version, uint32_t id)
+{
+	struct wl_resource *resource = wl_resource_create(client,
+			&wl_seat_interface, (int)version, id);
+	if ( resource == NULL )
+	{
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(resource, &seat_implementation, NULL, NULL);
+
+	wl_seat_send_capabilities(resource, WL_SEAT_CAPABILITY_POINTER);
+	if ( version >= WL_SEAT_NAME_SINCE_VERSION )
+		wl_seat_send_name(resource, "mock-seat");
+}
+
+static void pointer_frame (void)
+{
+	if ( wl_resource_get_version(mock.pointer) >= WL_POINTER_FRAME_SINCE_VERSION )
+		wl_pointer_send_frame(mock.pointer);
+}
+
+/*********************
+ *                   *
+ *  Protocol logger  *
+ *                   *
+ *********************/
+static struct Pool_size *get_pool_size (uint32_t id)
+{
+	for (size_t i = 0; i < mock.pool_amount; i++)
+		if ( mock.pools[i].id == id )
+			return &mock.pools[i];
+
+	struct Pool_size *pools = realloc(mock.pools,
+			(mock.pool_amount + 1) * sizeof(struct Pool_size));
+	if ( pools == NULL )
+		return NULL;
+	mock.pools = pools;
+	mock.pools[mock.pool_amount].id   = id;
+	mock.pools[mock.pool_amount].size = 0;
+	return &mock.pools[mock.pool_amount++];
+}
+
+/* Counts the shm memory the client maps. The shm global is implemented by
+ * libwayland-server itself, so this is the only place where it is visible.
+ */
+static void account_shm (const struct wl_protocol_logger_message *message)
+{
+	const char *class = wl_resource_get_class(message->resource);
+	const char *name  = message->message->name;
+
+	uint32_t id;
+	int32_t  size;
+	if ( ! strcmp(class, "wl_shm") && ! strcmp(name, "create_pool") )
+		id = message->arguments[0].n, size = message->arguments[2].i;
+	else if ( ! strcmp(class, "wl_shm_pool") && ! strcmp(name, "resize") )
+		id = wl_resource_get_id(message->resource), size = message->arguments[0].i;
+	else
+		return;
+
+	struct Pool_size *pool = get_pool_size(id);
+	if ( pool == NULL )
+		return;
+
+	/* A new pool with a recycled id starts from scratch. */
+	if ( ! strcmp(name, "create_pool") )
+		pool->size = 0;
+	if ( size > pool->size )
+		mock.stats[mock.phase].shm_bytes += (unsigned long long)(size - pool->size);
+	pool->size = size;
+}
+
+static void protocol_logger (void *data, enum wl_protocol_logger_type type,
+		const struct wl_protocol_logger_message *message)
+{
+	if ( mock.phase == PHASE_DONE )
+		return;
+
+	if ( type == WL_PROTOCOL_LOGGER_EVENT )
+	{
+		mock.stats[mock.phase].events++;
+		return;
+	}
+
+	mock.stats[mock.phase].requests++;
+	account_shm(message);
+
+	/* An interaction is complete once the client has been quiet for a bit. */
+	if ( mock.phase != PHASE_STARTUP || mock.phase_committed )
+		wl_event_source_timer_update(mock.idle_timer, IDLE_TIMEOUT_MS);
+}
+
+/************
+ *          *
+ *  Script  *
+ *          *
+ ************/
+static void start_phase (enum Phase phase)
+{
+	mock.phase           = phase;
+	mock.phase_start     = now();
+	mock.phase_committed = false;
+	wl_event_source_timer_update(mock.idle_timer, IDLE_TIMEOUT_MS);
+}
+
+/* Moves the pointer across the entire length of the bar. */
+static void run_pointer_sweep (void)
+{
+	struct Mock_layer_surface *layer_surface = mock.layer_surface;
+	struct wl_resource *surface = layer_surface->surface->resource;
+	const wl_fixed_t y = wl_fixed_from_int((int)layer_surface->configured_h / 2);
+
+	wl_pointer_send_enter(mock.pointer, wl_display_next_serial(mock.display),
+			surface, wl_fixed_from_int(0), y);
+	pointer_frame();
+
+	for (uint32_t x = 0; x < layer_surface->configured_w; x++)
+	{
+		wl_pointer_send_motion(mock.pointer, time_ms(), wl_fixed_from_int((int)x), y);
+		pointer_frame();
+		mock.stats[PHASE_POINTER_SWEEP].interactions++;
+	}
+
+	wl_pointer_send_leave(mock.pointer, wl_display_next_serial(mock.display), surface);
+	pointer_frame();
+}
+
+/* Clicks the button in the middle of the bar a number of times. */
+static void run_clicks (void)
+{
+	struct Mock_layer_surface *layer_surface = mock.layer_surface;
+	struct wl_resource *surface = layer_surface->surface->resource;
+	const wl_fixed_t x = wl_fixed_from_int((int)layer_surface->configured_w / 2);
+	const wl_fixed_t y = wl_fixed_from_int((int)layer_surface->configured_h / 2);
+
+	wl_pointer_send_enter(mock.pointer, wl_display_next_serial(mock.display),
+			surface, x, y);
+	pointer_frame();
+
+	/* Left mouse button, as defined in linux/input-event-codes.h */
+	const uint32_t button = 0x110;
+	for (int i = 0; i < CLICKS; i++)
+	{
+		wl_pointer_send_button(mock.pointer, wl_display_next_serial(mock.display),
+				time_ms(), button, WL_POINTER_BUTTON_STATE_PRESSED);
+		pointer_frame();
+		wl_pointer_send_button(mock.pointer, wl_display_next_serial(mock.display),
+				time_ms(), button, WL_POINTER_BUTTON_STATE_RELEASED);
+		pointer_frame();
+		mock.stats[PHASE_CLICKS].interactions++;
+	}
+
+	wl_pointer_send_leave(mock.pointer, wl_display_next_serial(mock.display), surface);
+	pointer_frame();
+}
+
+/* Replaces the output with a new one, like unplugging one monitor and
+ * plugging in another.
+ */
+static bool run_hotplug (void)
+{
+	wl_global_destroy(mock.outputs[0].global);
+	mock.outputs[0].global = NULL;
+	mock.stats[PHASE_HOTPLUG].interactions++;
+	return create_output(&mock.outputs[1], "MOCK-2");
+}
+
+/* Toggles the scale of the output, so the bar has to be rendered into new
+ * buffers. Done once per commit while the mock holds all buffers, until the
+ * swapchains of LavaLauncher have run dry.
+ */
+static bool change_scale (void)
+{
+	struct wl_resource *output = mock.outputs[1].resource;
+	if ( output == NULL || wl_resource_get_version(output) < WL_OUTPUT_SCALE_SINCE_VERSION )
+		return false;
+
+	mock.scale = mock.scale == 1 ? 2 : 1;
+	mock.scale_changes++;
+	mock.stats[PHASE_HELD_BUFFERS].interactions++;
+	wl_output_send_scale(output, mock.scale);
+	wl_output_send_done(output);
+	return true;
+}
+
+/* Whether the bar shows a buffer rendered for the current scale. */
+static bool bar_buffer_matches_scale (void)
+{
+	struct Mock_layer_surface *layer_surface = mock.layer_surface;
+	if ( layer_surface == NULL || layer_surface->surface == NULL
+			|| layer_surface->surface->current_buffer == NULL )
+		return false;
+
+	struct wl_shm_buffer *buffer = wl_shm_buffer_get(layer_surface->surface->current_buffer);
+	return buffer != NULL && wl_shm_buffer_get_height(buffer)
+		== (int32_t)layer_surface->configured_h * mock.scale;
+}
+
+/* Called for every commit of a bar surface which attaches a buffer. */
+static void phase_commit (void)
+{
+	mock.stats[mock.phase].commits++;
+	if (mock.phase_committed)
+		return;
+
+	mock.phase_committed = true;
+	mock.stats[mock.phase].time_to_commit_ms = ms_since(&mock.phase_start);
+	if ( mock.phase == PHASE_STARTUP )
+		wl_event_source_timer_update(mock.idle_timer, IDLE_TIMEOUT_MS);
+}
+
+/* Called for every commit of a bar surface, after phase_commit(). */
+static void phase_commit_done (void)
+{
+	if ( mock.phase == PHASE_HELD_BUFFERS && mock.hold_buffers
+			&& mock.scale_changes < HELD_SCALE_CHANGES )
+		change_scale();
+}
+
+static int handle_idle_timeout (void *data)
+{
+	switch (mock.phase)
+	{
+		case PHASE_STARTUP:
+			if ( mock.layer_surface == NULL || mock.pointer == NULL )
+			{
+				fputs("ERROR: lavalauncher did not create a bar or bind a pointer.\n", stderr);
+				goto error;
+			}
+			start_phase(PHASE_POINTER_SWEEP);
+			run_pointer_sweep();
+			break;
+
+		case PHASE_POINTER_SWEEP:
+			start_phase(PHASE_CLICKS);
+			run_clicks();
+			break;
+
+		case PHASE_CLICKS:
+			start_phase(PHASE_HOTPLUG);
+			if (! run_hotplug())
+				goto error;
+			break;
+
+		case PHASE_HOTPLUG:
+			if (! mock.phase_committed)
+			{
+				fputs("ERROR: lavalauncher did not map a bar on the new output.\n", stderr);
+				goto error;
+			}
+			start_phase(PHASE_HELD_BUFFERS);
+			mock.hold_buffers = true;
+			if (! change_scale())
+				goto error;
+			break;
+
+		/* Once LavaLauncher is quiet, its swapchains have run dry. After
+		 * the buffers are released, it must render the latest state.
+		 */
+		case PHASE_HELD_BUFFERS:
+			if (mock.hold_buffers)
+			{
+				release_held_buffers();
+				mock.phase_committed = false;
+				wl_event_source_timer_update(mock.idle_timer, IDLE_TIMEOUT_MS);
+				break;
+			}
+			if ( ! mock.phase_committed || ! bar_buffer_matches_scale() )
+			{
+				fputs("ERROR: lavalauncher did not render the bar again after "
+						"its buffers were released.\n", stderr);
+				goto error;
+			}
+			mock.phase = PHASE_DONE;
+			mock.ret   = EXIT_SUCCESS;
+			wl_display_terminate(mock.display);
+			break;
+
+		case PHASE_DONE:
+			break;
+	}
+	return 0;
+
+error:
+	mock.phase = PHASE_DONE;
+	wl_display_terminate(mock.display);
+	return 0;
+}
+
+static int handle_run_timeout (void *data)
+{
+	fprintf(stderr, "ERROR: Timed out in phase %s.\n", phase_names[mock.phase]);
+	mock.phase = PHASE_DONE;
+	wl_display_terminate(mock.display);
+	return 0;
+}
+
+static void print_report (void)
+{
+	printf("startup-to-first-commit: %.3f ms\n",
+			mock.stats[PHASE_STARTUP].time_to_commit_ms);
+	printf("hotplug-to-first-commit: %.3f ms\n\n",
+			mock.stats[PHASE_HOTPLUG].time_to_commit_ms);
+
+	printf("%-16s %12s %10s %10s %8s %14s %14s %12s\n", "phase", "interactions",
+			"requests", "events", "commits", "requests/int", "events/int", "shm-bytes");
+	for (int i = 0; i < PHASE_DONE; i++)
+	{
+		struct Phase_stats *stats = &mock.stats[i];
+		const double n = stats->interactions == 0 ? 1.0 : (double)stats->interactions;
+		printf("%-16s %12lu %10lu %10lu %8lu %14.2f %14.2f %12llu\n", phase_names[i],
+				stats->interactions, stats->requests, stats->events, stats->commits,
+				(double)stats->requests / n, (double)stats->events / n,
+				stats->shm_bytes);
+	}
+}
+
+/***********
+ *         *
+ *  Setup  *
+ *         *
+ ***********/
+static bool write_config (void)
+{
+	char buttons[sizeof(button_config) * BAR_BUTTONS];
+	buttons[0] = '\0';
+	for (int i = 0; i < BAR_BUTTONS; i++)
+		strcat(buttons, button_config);
+
+	size_t len = strlen(mock.runtime_dir) + strlen("/lavalauncher.conf") + 1;
+	if ( NULL == (mock.config_path = malloc(len)) )
+		return false;
+	snprintf(mock.config_path, len, "%s/lavalauncher.conf", mock.runtime_dir);
+
+	FILE *file = fopen(mock.config_path, "w");
+	if ( file == NULL )
+	{
+		fprintf(stderr, "ERROR: Can not write %s: %s\n", mock.config_path, strerror(errno));
+		return false;
+	}
+	fprintf(file, config_template, BAR_SIZE, buttons);
+	fclose(file);
+	return true;
+}
+
+/* libwayland-server needs XDG_RUNTIME_DIR for its socket, which is not
+ * necessarily set when running as part of a build.
+ */
+static bool setup_runtime_dir (void)
+{
+	const char *runtime_dir = getenv("XDG_RUNTIME_DIR");
+	if ( runtime_dir != NULL )
+	{
+		mock.runtime_dir = strdup(runtime_dir);
+		return mock.runtime_dir != NULL;
+	}
+
+	if ( NULL == (mock.runtime_dir = strdup("/tmp/lavalauncher-bench-XXXXXX")) )
+		return false;
+	if ( mkdtemp(mock.runtime_dir) == NULL )
+	{
+		fprintf(stderr, "ERROR: mkdtemp: %s\n", strerror(errno));
+		return false;
+	}
+	mock.own_runtime_dir = true;
+	return setenv("XDG_RUNTIME_DIR", mock.runtime_dir, 1) == 0;
+}
+
+static bool spawn_client (const char *path, const char *socket)
+{
+	mock.phase_start = now();
+	mock.child = fork();
+	if ( mock.child == -1 )
+	{
+		fprintf(stderr, "ERROR: fork: %s\n", strerror(errno));
+		return false;
+	}
+	if ( mock.child == 0 )
+	{
+		setenv("WAYLAND_DISPLAY", socket, 1);
+		execl(path, path, "-c", mock.config_path, (char *)NULL);
+		fprintf(stderr, "ERROR: Can not execute %s: %s\n", path, strerror(errno));
+		_exit(EXIT_FAILURE);
+	}
+	return true;
+}
+
+/* SIGINT, because that is what lavalauncher handles to exit cleanly. */
+static void stop_client (void)
+{
+	if ( mock.child <= 0 )
+		return;
+
+	kill(mock.child, SIGINT);
+	for (int i = 0; i < 100; i++)
+	{
+		if ( waitpid(mock.child, NULL, WNOHANG) == mock.child )
+			return;
+		wl_event_loop_dispatch(mock.loop, 10);
+		wl_display_flush_clients(mock.display);
+	}
+	kill(mock.child, SIGKILL);
+	waitpid(mock.child, NULL, 0);
+}
+
+int main (int argc, char *argv[])
+{
+	mock.ret = EXIT_FAILURE;
+
+	if ( argc != 2 )
+	{
+		fprintf(stderr, "Usage: %s /path/to/lavalauncher\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (! setup_runtime_dir())
+		goto exit;
+	if (! write_config())
+		goto exit;
+
+	if ( NULL == (mock.display = wl_display_create()) )
+		goto exit;
+	mock.loop = wl_display_get_event_loop(mock.display);
+
+	const char *socket = wl_display_add_socket_auto(mock.display);
+	if ( socket == NULL )
+	{
+		fputs("ERROR: Can not create Wayland socket.\n", stderr);
+		goto exit;
+	}
+
+	if ( wl_display_init_shm(mock.display) != 0
+			|| ! wl_global_create(mock.display, &wl_compositor_interface, 4, NULL, compositor_bind)
+			|| ! wl_global_create(mock.display, &wl_subcompositor_interface, 1, NULL, subcompositor_bind)
+			|| ! wl_global_create(mock.display, &zwlr_layer_shell_v1_interface, 4, NULL, layer_shell_bind)
+			|| ! wl_global_create(mock.display, &zxdg_output_manager_v1_interface, 3, NULL, xdg_output_manager_bind)
+			|| ! wl_global_create(mock.display, &wl_seat_interface, 5, NULL, seat_bind)
+			|| ! create_output(&mock.outputs[0], "MOCK-1") )
+	{
+		fputs("ERROR: Can not create globals.\n", stderr);
+		goto exit;
+	}
+
+	wl_display_add_protocol_logger(mock.display, protocol_logger, NULL);
+
+	wl_list_init(&mock.frame_callbacks);
+	wl_list_init(&mock.held_buffers);
+	mock.scale = 1;
+	mock.idle_timer  = wl_event_loop_add_timer(mock.loop, handle_idle_timeout, NULL);
+	mock.run_timer   = wl_event_loop_add_timer(mock.loop, handle_run_timeout, NULL);
+	mock.frame_timer = wl_event_loop_add_timer(mock.loop, handle_frame_timer, NULL);
+	if ( mock.idle_timer == NULL || mock.run_timer == NULL || mock.frame_timer == NULL )
+		goto exit;
+	wl_event_source_timer_update(mock.run_timer, RUN_TIMEOUT_MS);
+
+	mock.phase = PHASE_STARTUP;
+	mock.stats[PHASE_STARTUP].interactions = 1;
+	if (! spawn_client(argv[1], socket))
+		goto exit;
+
+	wl_display_run(mock.display);
+
+	if ( mock.ret == EXIT_SUCCESS )
+		print_report();
+
+exit:
+	if ( mock.display != NULL )
+	{
+		stop_client();
+		wl_display_destroy_clients(mock.display);
+		wl_display_destroy(mock.display);
+	}
+	if ( mock.config_path != NULL )
+	{
+		unlink(mock.config_path);
+		free(mock.config_path);
+	}
+	if (mock.own_runtime_dir)
+		rmdir(mock.runtime_dir);
+	free(mock.runtime_dir);
+	free(mock.pools);
+	return mock.ret;
+}
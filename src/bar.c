@@ -41,6 +41,7 @@
 #include"item.h"
 #include"output.h"
 #include"bar.h"
+#include"draw.h"
 #include"types/colour_t.h"
 #include"types/box_t.h"
 
@@ -198,6 +199,35 @@ struct Lava_bar_configuration *get_bar_config_for_output (struct Lava_bar *bar,
 	return NULL;
 }
 
+static bool bar_config_equal (struct Lava_bar_configuration *a, struct Lava_bar_configuration *b)
+{
+	return a->position == b->position
+		&& a->alignment == b->alignment
+		&& a->mode == b->mode
+		&& a->orientation == b->orientation
+		&& a->layer == b->layer
+		&& a->size == b->size
+		&& a->icon_padding == b->icon_padding
+		&& udirections_t_equal(&a->border, &b->border)
+		&& udirections_t_equal(&a->margin, &b->margin)
+		&& uradii_t_equal(&a->radii, &b->radii)
+		&& a->hidden_size == b->hidden_size
+		&& a->hidden_mode == b->hidden_mode
+		&& colour_t_equal(&a->bar_colour, &b->bar_colour)
+		&& colour_t_equal(&a->border_colour, &b->border_colour)
+		&& a->indicator_padding == b->indicator_padding
+		&& colour_t_equal(&a->indicator_hover_colour, &b->indicator_hover_colour)
+		&& colour_t_equal(&a->indicator_active_colour, &b->indicator_active_colour)
+		&& a->indicator_style == b->indicator_style
+		&& string_equal(a->only_output, b->only_output)
+		&& string_equal(a->namespace, b->namespace)
+		&& a->exclusive_zone == b->exclusive_zone
+		&& string_equal(a->cursor_name, b->cursor_name)
+		&& a->condition_scale == b->condition_scale
+		&& a->condition_transform == b->condition_transform
+		&& a->condition_resolution == b->condition_resolution;
+}
+
 
 /***************
  * Logical bar *
@@ -206,9 +236,12 @@ bool create_bar (void)
 {
 	TRY_NEW(struct Lava_bar, bar, false);
 
-	bar->last_item      = NULL;
-	bar->last_config    = NULL;
-	bar->default_config = NULL;
+	bar->last_item        = NULL;
+	bar->last_config      = NULL;
+	bar->default_config   = NULL;
+	bar->item_array       = NULL;
+	bar->item_at_ordinate = NULL;
+	bar->item_length_sum  = 0;
 
 	wl_list_init(&bar->items);
 	wl_list_init(&bar->configs);
@@ -251,6 +284,136 @@ void destroy_all_bars (void)
 		destroy_bar(bar);
 }
 
+static bool bar_equal (struct Lava_bar *a, struct Lava_bar *b)
+{
+	if (! items_equal(a, b))
+		return false;
+
+	if ( wl_list_length(&a->configs) != wl_list_length(&b->configs) )
+		return false;
+
+	struct Lava_bar_configuration *config_a, *config_b;
+	config_b = wl_container_of(b->configs.next, config_b, link);
+	wl_list_for_each(config_a, &a->configs, link)
+	{
+		if (! bar_config_equal(config_a, config_b))
+			return false;
+		config_b = wl_container_of(config_b->link.next, config_b, link);
+	}
+
+	return true;
+}
+
+static void destroy_all_bar_instances_of_bar (struct Lava_bar *bar)
+{
+	struct Lava_output *output;
+	wl_list_for_each(output, &context.outputs, link)
+		destroy_bar_instance(bar_instance_from_bar(bar, output));
+}
+
+/* Try to hand the instances of a replaced bar over to the bar replacing it.
+ * The layer and namespace of a layer surface can not be changed after it has
+ * been created, so in that case the instance must be recreated.
+ */
+static void bar_instances_switch_bar (struct Lava_bar *old_bar, struct Lava_bar *new_bar)
+{
+	const bool same_items = items_equal(old_bar, new_bar);
+
+	struct Lava_output *output;
+	wl_list_for_each(output, &context.outputs, link)
+	{
+		struct Lava_bar_instance *instance = bar_instance_from_bar(old_bar, output);
+		if ( instance == NULL )
+			continue;
+
+		struct Lava_bar_configuration *config = get_bar_config_for_output(new_bar, output);
+		if ( config == NULL || config->layer != instance->config->layer
+				|| ! string_equal(config->namespace, instance->config->namespace) )
+		{
+			destroy_bar_instance(instance);
+			continue;
+		}
+
+		/* The items of the old bar will be destroyed, so the seats must
+		 * not refer to them anymore, even if they are identical.
+		 */
+		seats_forget_items(instance);
+		if (! same_items)
+		{
+			struct Lava_item_indicator *indicator, *temp;
+			wl_list_for_each_safe(indicator, temp, &instance->indicators, link)
+				destroy_indicator(indicator);
+			DESTROY_NULL(instance->icon_atlas, cairo_surface_destroy);
+			instance->icon_atlas_direct = false;
+		}
+
+		instance->bar    = new_bar;
+		instance->config = config;
+	}
+}
+
+/* When the configuration is reloaded, the freshly parsed bars are compared
+ * against the old ones, which are matched by their position in the
+ * configuration file. Old bars identical to their replacement are kept as
+ * they are, so that their surfaces are not touched at all. For all other bars
+ * the existing instances are reused if possible and only updated. Afterwards
+ * the old bars which have been replaced are destroyed.
+ */
+void replace_bars (struct wl_list *old_bars)
+{
+	log_message(1, "[bar] Replacing bars.\n");
+
+	struct wl_list unused_bars;
+	wl_list_init(&unused_bars);
+
+	struct wl_list *old_link = old_bars->next, *new_link = context.bars.next;
+	while ( old_link != old_bars )
+	{
+		struct Lava_bar *old_bar = wl_container_of(old_link, old_bar, link);
+		old_link = old_link->next;
+		wl_list_remove(&old_bar->link);
+
+		/* Bar has been removed from the configuration. */
+		if ( new_link == &context.bars )
+		{
+			destroy_all_bar_instances_of_bar(old_bar);
+			wl_list_insert(&unused_bars, &old_bar->link);
+			continue;
+		}
+
+		struct Lava_bar *new_bar = wl_container_of(new_link, new_bar, link);
+		new_link = new_link->next;
+
+		if (bar_equal(old_bar, new_bar))
+		{
+			log_message(2, "[bar] Bar unchanged; Keeping it.\n");
+			wl_list_insert(&new_bar->link, &old_bar->link);
+			wl_list_remove(&new_bar->link);
+			wl_list_insert(&unused_bars, &new_bar->link);
+			continue;
+		}
+
+		log_message(2, "[bar] Bar changed; Updating it.\n");
+		items_carry_launch_state(old_bar, new_bar);
+		bar_instances_switch_bar(old_bar, new_bar);
+		wl_list_insert(&unused_bars, &old_bar->link);
+		update_bar_on_all_outputs(new_bar);
+	}
+
+	/* Bars that have been added to the configuration. */
+	for (; new_link != &context.bars; new_link = new_link->next)
+	{
+		struct Lava_bar *new_bar = wl_container_of(new_link, new_bar, link);
+		update_bar_on_all_outputs(new_bar);
+	}
+
+	struct Lava_bar *bar, *temp;
+	wl_list_for_each_safe(bar, temp, &unused_bars, link)
+		destroy_bar(bar);
+
+	context.last_bar = NULL;
+}
+
 /***********************
  *                     *
  *  Bar configuration  *
@@ -649,33 +812,6 @@ exit:
 	return false;
 }
 
-/********************************
- * Generic cairo draw functions *
- ********************************/
-static void circle (cairo_t *cairo, uint32_t x, uint32_t y, uint32_t size)
-{
-	cairo_arc(cairo, x + (size/2.0), y + (size/2.0), size / 2.0, 0, 2 * 3.1415927);
-}
-
-static void rounded_rectangle (cairo_t *cairo, uint32_t x, uint32_t y, uint32_t w, uint32_t h, uradii_t *radii)
-{
-	double degrees = 3.1415927 / 180.0;
-	cairo_new_sub_path(cairo);
-	cairo_arc(cairo, x + w - radii->top_right,    y     + radii->top_right,    radii->top_right,   -90 * degrees,   0 * degrees);
-	cairo_arc(cairo, x + w - radii->bottom_right, y + h - radii->bottom_right, radii->bottom_right,  0 * degrees,  90 * degrees);
-	cairo_arc(cairo, x     + radii->bottom_left,  y + h - radii->bottom_left,  radii->bottom_left,  90 * degrees, 180 * degrees);
-	cairo_arc(cairo, x     + radii->top_left,     y     + radii->top_left,     radii->top_left,    180 * degrees, 270 * degrees);
-	cairo_close_path(cairo);
-}
-
-static void clear_buffer (cairo_t *cairo)
-{
-	cairo_save(cairo);
-	cairo_set_operator(cairo, CAIRO_OPERATOR_CLEAR);
-	cairo_paint(cairo);
-	cairo_restore(cairo);
-}
-
 /**************
  * Indicators *
  **************/
@@ -690,15 +826,12 @@ void destroy_indicator (struct Lava_item_indicator *indicator)
 	if ( indicator->touchpoint != NULL )
 		indicator->touchpoint->indicator = NULL;
 
-	finish_buffer(&indicator->indicator_buffers[0]);
-	finish_buffer(&indicator->indicator_buffers[1]);
-
 	wl_surface_commit(indicator->instance->bar_surface);
 	wl_list_remove(&indicator->link);
 	free(indicator);
 }
 
-struct Lava_item_indicator *create_indicator (struct Lava_bar_instance *instance)
+static struct Lava_item_indicator *create_indicator (struct Lava_bar_instance *instance)
 {
 	TRY_NEW(struct Lava_item_indicator, indicator, NULL);
 
@@ -707,6 +840,8 @@ struct Lava_item_indicator *create_indicator (struct Lava_bar_instance *instance
 	indicator->seat       = NULL;
 	indicator->touchpoint = NULL;
 	indicator->instance   = instance;
+	indicator->in_use     = false;
+	indicator->state      = INDICATOR_HOVER;
 
 	if ( NULL == (indicator->indicator_surface = wl_compositor_create_surface(context.compositor)) )
 	{
@@ -735,51 +870,143 @@ error:
 	return NULL;
 }
 
-void indicator_set_colour (struct Lava_item_indicator *indicator, colour_t *colour)
+/* Indicators are pooled per bar instance. Unused indicators are hidden by
+ * attaching a NULL buffer and are kept together with their buffers, so that
+ * moving the pointer along the bar does not create or destroy any objects.
+ */
+struct Lava_item_indicator *take_indicator (struct Lava_bar_instance *instance)
 {
-	struct Lava_bar_instance      *instance = indicator->instance;
-	struct Lava_bar_configuration *config   = instance->config;
-	uint32_t                       scale    = instance->output->scale;
+	struct Lava_item_indicator *indicator;
+	wl_list_for_each(indicator, &instance->indicators, link)
+		if (! indicator->in_use)
+		{
+			indicator->in_use = true;
+			return indicator;
+		}
+
+	log_message(2, "[bar] Creating indicator: global_name=%d\n",
+			instance->output->global_name);
+	if ( NULL != (indicator = create_indicator(instance)) )
+		indicator->in_use = true;
+	return indicator;
+}
+
+void release_indicator (struct Lava_item_indicator *indicator)
+{
+	if ( indicator->seat != NULL )
+		indicator->seat->pointer.indicator = NULL;
+	if ( indicator->touchpoint != NULL )
+		indicator->touchpoint->indicator = NULL;
+
+	indicator->seat       = NULL;
+	indicator->touchpoint = NULL;
+	indicator->in_use     = false;
+
+	wl_surface_attach(indicator->indicator_surface, NULL, 0, 0);
+	wl_surface_commit(indicator->indicator_surface);
+	wl_surface_commit(indicator->instance->bar_surface);
+}
+
+/* Render the hover and active indicator images of a bar instance, unless they
+ * are already up to date. Indicators only ever attach these buffers.
+ */
+static bool bar_instance_update_indicator_sprites (struct Lava_bar_instance *instance)
+{
+	struct Lava_bar_configuration *config = instance->config;
+	uint32_t                       scale  = instance->output->scale;
 
 	uint32_t buffer_size = config->size - (2 * config->indicator_padding);
 	buffer_size *= scale;
 
-	/* Get new/next buffer. */
-	if (! next_buffer(&indicator->current_indicator_buffer,
-				context.shm, indicator->indicator_buffers,
-				buffer_size, buffer_size))
+	/* Replaced images, which indicators in use may still show. */
+	struct Lava_buffer old[2];
+	memset(old, 0, sizeof(old));
+
+	bool changed = false, ret = true;
+	for (int i = 0; i < 2; i++)
 	{
-		destroy_indicator(indicator);
-		return;
-	}
+		struct Lava_indicator_sprite *sprite = &instance->indicator_sprites[i];
+		colour_t *colour = i == INDICATOR_HOVER ? &config->indicator_hover_colour
+			: &config->indicator_active_colour;
 
-	cairo_t *cairo = indicator->current_indicator_buffer->cairo;
-	clear_buffer(cairo);
-	cairo_set_antialias(cairo, CAIRO_ANTIALIAS_BEST);
+		if ( sprite->valid && sprite->style == config->indicator_style
+				&& sprite->size == buffer_size
+				&& colour_t_equal(&sprite->colour, colour)
+				&& uradii_t_equal(&sprite->radii, &config->radii) )
+			continue;
 
-	switch (config->indicator_style)
-	{
-		case STYLE_RECTANGLE:
-			/* Cairo implicitly fills everything if no shape has been drawn. */
-			cairo_rectangle(cairo, 0, 0, buffer_size, buffer_size);
-			break;
+		log_message(2, "[bar] Rendering indicator sprite: global_name=%d\n",
+				instance->output->global_name);
 
-		case STYLE_ROUNDED_RECTANGLE:
-			rounded_rectangle(cairo, 0, 0, buffer_size, buffer_size, &config->radii);
+		old[i] = sprite->buffer;
+		memset(&sprite->buffer, 0, sizeof(struct Lava_buffer));
+		if ( ! create_buffer(context.shm, &instance->output->shm_pool,
+					&sprite->buffer, buffer_size, buffer_size)
+				|| sprite->buffer.cairo == NULL )
+		{
+			finish_buffer(&sprite->buffer);
+			sprite->buffer = old[i];
+			memset(&old[i], 0, sizeof(struct Lava_buffer));
+			ret = false;
 			break;
+		}
 
-		case STYLE_CIRCLE:
-			circle(cairo, 0, 0, buffer_size);
-			break;
+		draw_indicator(sprite->buffer.cairo, config->indicator_style,
+				buffer_size, &config->radii, colour);
+		cairo_surface_flush(sprite->buffer.surface);
+
+		sprite->style  = config->indicator_style;
+		sprite->size   = buffer_size;
+		sprite->colour = *colour;
+		sprite->radii  = config->radii;
+		sprite->valid  = true;
+		changed        = true;
 	}
 
-	colour_t_set_cairo_source(cairo, colour);
-	cairo_fill(cairo);
+	/* Indicators in use still show the old images. */
+	if (changed)
+	{
+		struct Lava_item_indicator *indicator;
+		wl_list_for_each(indicator, &instance->indicators, link) if (indicator->in_use)
+		{
+			indicator_set_state(indicator, indicator->state);
+			wl_surface_commit(indicator->indicator_surface);
+		}
+	}
 
-	wl_surface_set_buffer_scale(indicator->indicator_surface, (int32_t)scale);
+	/* Only now that nothing shows them anymore; Those the compositor still
+	 * holds are kept by the pool until it releases them.
+	 */
+	for (int i = 0; i < 2; i++)
+		finish_buffer(&old[i]);
+
+	return ret;
+}
+
+static void finish_indicator_sprites (struct Lava_bar_instance *instance)
+{
+	for (int i = 0; i < 2; i++)
+	{
+		finish_buffer(&instance->indicator_sprites[i].buffer);
+		instance->indicator_sprites[i].valid = false;
+	}
+}
+
+void indicator_set_state (struct Lava_item_indicator *indicator, enum Indicator_state state)
+{
+	struct Lava_bar_instance *instance = indicator->instance;
+
+	indicator->state = state;
+
+	if ( ! instance->indicator_sprites[state].valid
+			&& ! bar_instance_update_indicator_sprites(instance) )
+		return;
+
+	wl_surface_set_buffer_scale(indicator->indicator_surface, (int32_t)instance->output->scale);
 	wl_surface_attach(indicator->indicator_surface,
-			indicator->current_indicator_buffer->buffer, 0, 0);
+			instance->indicator_sprites[state].buffer.buffer, 0, 0);
 	wl_surface_damage_buffer(indicator->indicator_surface, 0, 0, INT32_MAX, INT32_MAX);
+	instance->indicator_sprites[state].buffer.busy = true;
 }
 
 void move_indicator (struct Lava_item_indicator *indicator, struct Lava_item *item)
@@ -806,143 +1033,292 @@ void indicator_commit (struct Lava_item_indicator *indicator)
 /****************
  * Bar instance *
  ****************/
-static void draw_items (struct Lava_bar_instance *instance, cairo_t *cairo)
+/* Largest width and height of a cairo image surface. */
+#define ICON_ATLAS_MAX_SIZE 32767
+
+/* Rasterize every distinct image of the bar once into the icon atlas, rows of
+ * icon sized cells, so that drawing the icons only needs plain blits. The atlas
+ * is only re-created when the scale, size or icon padding change, or when the
+ * items of the bar are replaced. If the atlas can not be created, icons are
+ * rasterized directly whenever they are drawn.
+ */
+static bool bar_instance_update_icon_atlas (struct Lava_bar_instance *instance)
 {
 	struct Lava_bar_configuration *config = instance->config;
 	struct Lava_bar               *bar    = instance->bar;
 
 	uint32_t scale = instance->output->scale;
-	uint32_t size = config->size * scale;
-	uint32_t *increment, increment_offset;
-	uint32_t x = 0, y = 0;
-	if ( config->orientation == ORIENTATION_HORIZONTAL )
-		increment = &x, increment_offset = x;
-	else
-		increment = &y, increment_offset = y;
+	if ( ( instance->icon_atlas != NULL || instance->icon_atlas_direct )
+			&& instance->icon_atlas_scale   == scale
+			&& instance->icon_atlas_size    == config->size
+			&& instance->icon_atlas_padding == config->icon_padding )
+		return true;
+
+	DESTROY_NULL(instance->icon_atlas, cairo_surface_destroy);
+	instance->icon_atlas_direct = false;
+
+	const int cell = (int)(config->size * scale) - (int)(2 * config->icon_padding);
+	if ( bar->atlas_slots == 0 || cell <= 0 )
+		return false;
+
+	/* Icons have to be drawn again, either from the new atlas or directly. */
+	instance->icon_atlas_scale   = scale;
+	instance->icon_atlas_size    = config->size;
+	instance->icon_atlas_padding = config->icon_padding;
+	instance->icon_full_change   = instance->icon_frame + 1;
+	instance->icon_last_change   = instance->icon_full_change;
+
+	/* Roughly square, so neither side hits the size limit of cairo early. */
+	int slots   = (int)bar->atlas_slots;
+	int columns = 1;
+	while ( columns * columns < slots )
+		columns++;
+	if ( columns > ICON_ATLAS_MAX_SIZE / cell )
+		columns = ICON_ATLAS_MAX_SIZE / cell;
+	const int rows = columns > 0 ? (slots + columns - 1) / columns : 0;
+	if ( columns == 0 || rows > ICON_ATLAS_MAX_SIZE / cell )
+	{
+		log_message(1, "[bar] Too many icons for an icon atlas, drawing them directly: "
+				"slots=%d cell=%d\n", slots, cell);
+		instance->icon_atlas_direct = true;
+		return true;
+	}
+
+	log_message(2, "[bar] Rasterizing icon atlas: slots=%d cell=%d columns=%d\n",
+			slots, cell, columns);
 
+	cairo_surface_t *atlas = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+			cell * columns, cell * rows);
+	if ( cairo_surface_status(atlas) != CAIRO_STATUS_SUCCESS )
+	{
+		log_message(0, "ERROR: Can not create icon atlas, drawing icons directly: %s\n",
+				cairo_status_to_string(cairo_surface_status(atlas)));
+		cairo_surface_destroy(atlas);
+		instance->icon_atlas_direct = true;
+		return true;
+	}
+
+	cairo_t *cairo = cairo_create(atlas);
+	cairo_set_antialias(cairo, CAIRO_ANTIALIAS_BEST);
+
+	/* Slots are numbered in order of the first item using the image. */
+	unsigned int next_slot = 0;
 	struct Lava_item *item;
-	wl_list_for_each_reverse(item, &bar->items, link) if ( item->type == TYPE_BUTTON )
+	wl_list_for_each_reverse(item, &bar->items, link)
 	{
-		*increment = (item->ordinate * scale) + increment_offset;
-		if ( item->img != NULL )
-			image_t_draw_to_cairo(cairo, item->img,
-					x + config->icon_padding,
-					y + config->icon_padding,
-					size - (2 * config->icon_padding),
-					size - (2 * config->icon_padding));
+		if ( item->img == NULL || item->atlas_slot != next_slot )
+			continue;
+		image_t_draw_to_cairo(cairo, item->img,
+				(next_slot % (unsigned int)columns) * (uint32_t)cell,
+				(next_slot / (unsigned int)columns) * (uint32_t)cell,
+				(uint32_t)cell, (uint32_t)cell);
+		next_slot++;
 	}
+
+	cairo_destroy(cairo);
+
+	instance->icon_atlas         = atlas;
+	instance->icon_atlas_columns = (uint32_t)columns;
+
+	return true;
 }
 
-/* Draw a rectangle with configurable borders and corners. */
-void draw_bar_background (cairo_t *cairo, ubox_t *_dim, udirections_t *_border, uradii_t *_radii,
-		uint32_t scale, colour_t *bar_colour, colour_t *border_colour)
+static ubox_t item_buffer_box (struct Lava_bar_instance *instance, struct Lava_item *item)
 {
-	ubox_t        dim    = ubox_t_scale(_dim, scale);
-	udirections_t border = udirections_t_scale(_border, scale);
-	uradii_t      radii  = uradii_t_scale(_radii, scale);
+	uint32_t scale = instance->output->scale;
+	if ( instance->config->orientation == ORIENTATION_HORIZONTAL )
+		return (ubox_t){
+			.x = item->ordinate * scale,
+			.y = 0,
+			.w = item->length * scale,
+			.h = instance->icon_frame_h
+		};
+	else
+		return (ubox_t){
+			.x = 0,
+			.y = item->ordinate * scale,
+			.w = instance->icon_frame_w,
+			.h = item->length * scale
+		};
+}
 
-	ubox_t center = {
-		.x = dim.x + border.left,
-		.y = dim.y + border.top,
-		.w = dim.w - (border.left + border.right),
-		.h = dim.h - (border.top + border.bottom)
-	};
+static void draw_item (struct Lava_bar_instance *instance, cairo_t *cairo,
+		struct Lava_item *item)
+{
+	struct Lava_bar_configuration *config = instance->config;
 
-	/* Avoid radii so big they cause unexpected drawing behaviour. */
-	uint32_t smallest_side = center.w < center.h ? center.w : center.h;
-	if ( radii.top_left > smallest_side / 2 )
-		radii.top_left = smallest_side / 2;
-	if ( radii.top_right > smallest_side / 2 )
-		radii.top_right = smallest_side / 2;
-	if ( radii.bottom_left > smallest_side / 2 )
-		radii.bottom_left = smallest_side / 2;
-	if ( radii.bottom_right > smallest_side / 2 )
-		radii.bottom_right = smallest_side / 2;
+	ubox_t box = item_buffer_box(instance, item);
 
-	cairo_save(cairo);
-	cairo_set_operator(cairo, CAIRO_OPERATOR_SOURCE);
+	const uint32_t cell = config->size * instance->output->scale
+		- (2 * config->icon_padding);
 
-	if ( radii.top_left == 0 && radii.top_right == 0 && radii.bottom_left == 0 && radii.bottom_right == 0 )
+	if ( item->type != TYPE_BUTTON || item->img == NULL )
+		draw_item_icon(cairo, &box, NULL, 0, 0, 0, 0);
+	else if (instance->icon_atlas_direct)
+		draw_item_image(cairo, &box, item->img, cell, config->icon_padding);
+	else if ( instance->icon_atlas != NULL )
+		draw_item_icon(cairo, &box, instance->icon_atlas,
+				(item->atlas_slot % instance->icon_atlas_columns) * cell,
+				(item->atlas_slot / instance->icon_atlas_columns) * cell,
+				cell, config->icon_padding);
+	else
+		draw_item_icon(cairo, &box, NULL, 0, 0, 0, 0);
+}
+
+/* Compare the items of the bar to what is currently on the icon surface and
+ * remember which ones have changed.
+ */
+static bool bar_instance_update_icon_slots (struct Lava_bar_instance *instance)
+{
+	struct Lava_bar *bar  = instance->bar;
+	const uint64_t   next = instance->icon_frame + 1;
+
+	uint32_t scale = instance->output->scale;
+	uint32_t w = instance->item_area_dim.w * scale;
+	uint32_t h = instance->item_area_dim.h * scale;
+	if ( w != instance->icon_frame_w || h != instance->icon_frame_h )
 	{
-		if ( border.top == 0 && border.bottom == 0 && border.left == 0 && border.right == 0 )
-		{
-			cairo_rectangle(cairo, dim.x, dim.y, dim.w, dim.h);
-			colour_t_set_cairo_source(cairo, bar_colour);
-			cairo_fill(cairo);
-		}
-		else
-		{
-			/* Borders. */
-			cairo_rectangle(cairo, dim.x, dim.y, dim.w, border.top);
-			cairo_rectangle(cairo, dim.x + dim.w - border.right, dim.y + border.top,
-					border.right, dim.h - border.top - border.bottom);
-			cairo_rectangle(cairo, dim.x, dim.y + dim.h - border.bottom, dim.w, border.bottom);
-			cairo_rectangle(cairo, dim.x, dim.y + border.top, border.left,
-					dim.h - border.top - border.bottom);
-			colour_t_set_cairo_source(cairo, border_colour);
-			cairo_fill(cairo);
-
-			/* Center. */
-			cairo_rectangle(cairo, center.x, center.y, center.w, center.h);
-			colour_t_set_cairo_source(cairo, bar_colour);
-			cairo_fill(cairo);
-		}
+		instance->icon_frame_w     = w;
+		instance->icon_frame_h     = h;
+		instance->icon_full_change = next;
+		instance->icon_last_change = next;
 	}
-	else
+
+	/* May mark all icons as changed itself. */
+	bar_instance_update_icon_atlas(instance);
+
+	if ( instance->icon_slot_amount != bar->item_amount )
 	{
-		if ( border.top == 0 && border.bottom == 0 && border.left == 0 && border.right == 0 )
+		struct Lava_icon_slot *slots = realloc(instance->icon_slots,
+				(size_t)bar->item_amount * sizeof(struct Lava_icon_slot));
+		if ( slots == NULL )
 		{
-			rounded_rectangle(cairo, dim.x, dim.y, dim.w, dim.h, &radii);
-			colour_t_set_cairo_source(cairo, bar_colour);
-			cairo_fill(cairo);
+			log_message(0, "ERROR: Can not allocate.\n");
+			return false;
 		}
-		else
-		{
-			rounded_rectangle(cairo, dim.x, dim.y, dim.w, dim.h, &radii);
-			colour_t_set_cairo_source(cairo, border_colour);
-			cairo_fill(cairo);
+		instance->icon_slots       = slots;
+		instance->icon_slot_amount = bar->item_amount;
+		instance->icon_full_change = next;
+		instance->icon_last_change = next;
+		memset(slots, 0, (size_t)bar->item_amount * sizeof(struct Lava_icon_slot));
+	}
 
-			rounded_rectangle(cairo, center.x, center.y, center.w, center.h, &radii);
-			colour_t_set_cairo_source(cairo, bar_colour);
-			cairo_fill(cairo);
-		}
+	struct Lava_item *item;
+	wl_list_for_each(item, &bar->items, link)
+	{
+		struct Lava_icon_slot *slot = &instance->icon_slots[item->index];
+		const bool has_icon = item->type == TYPE_BUTTON && item->img != NULL;
+		if ( slot->ordinate == item->ordinate && slot->length == item->length
+				&& slot->has_icon == has_icon
+				&& slot->atlas_slot == item->atlas_slot )
+			continue;
+
+		slot->ordinate   = item->ordinate;
+		slot->length     = item->length;
+		slot->has_icon   = has_icon;
+		slot->atlas_slot = item->atlas_slot;
+		slot->changed    = next;
+		instance->icon_last_change = next;
 	}
 
-	cairo_restore(cairo);
+	return true;
 }
 
-static void bar_instance_render_icon_frame (struct Lava_bar_instance *instance)
+/* Returns false if no buffer was available to render into. */
+static bool bar_instance_render_icon_frame (struct Lava_bar_instance *instance)
 {
 	struct Lava_output *output  = instance->output;
 	uint32_t            scale   = output->scale;
 
+	/* A hidden bar shows no icons, but the buffer is kept for unhiding. */
+	if (instance->hidden)
+	{
+		if (instance->icon_buffer_attached)
+		{
+			wl_surface_attach(instance->icon_surface, NULL, 0, 0);
+			instance->icon_buffer_attached = false;
+		}
+		return true;
+	}
+
+	if (! bar_instance_update_icon_slots(instance))
+		return true;
+
+	struct Lava_buffer *front = instance->icon_swapchain.current;
+	const uint64_t front_frame = front == NULL ? 0 : front->frame;
+
+	if ( front != NULL && instance->icon_last_change <= front_frame )
+	{
+		log_message(2, "[bar] Icon frame unchanged: global_name=%d\n",
+				instance->output->global_name);
+		if (! instance->icon_buffer_attached)
+		{
+			wl_surface_set_buffer_scale(instance->icon_surface, (int32_t)scale);
+			swapchain_attach(&instance->icon_swapchain, instance->icon_surface);
+			wl_surface_damage_buffer(instance->icon_surface, 0, 0, INT32_MAX, INT32_MAX);
+			instance->icon_buffer_attached = true;
+		}
+		return true;
+	}
+
 	log_message(2, "[bar] Render icon frame: global_name=%d\n",
 			instance->output->global_name);
 
 	/* Get new/next buffer. */
-	if (! next_buffer(&instance->current_icon_buffer, context.shm, instance->icon_buffers,
-				instance->item_area_dim.w  * scale, instance->item_area_dim.h * scale))
-		return;
-
-	cairo_t *cairo = instance->current_icon_buffer->cairo;
-	clear_buffer(cairo);
+	if (! swapchain_next_buffer(&instance->icon_swapchain, context.shm,
+				&output->shm_pool, instance->icon_frame_w, instance->icon_frame_h))
+		return false;
 
+	struct Lava_buffer *back = instance->icon_swapchain.current;
+	cairo_t *cairo = back->cairo;
 	cairo_set_antialias(cairo, CAIRO_ANTIALIAS_BEST);
 
-	/* Draw icons. */
-	if (! instance->hidden)
-		draw_items(instance, cairo);
+	/* Only redraw what the buffer is missing and only damage what differs
+	 * from the buffer that has been attached so far.
+	 */
+	const bool redraw_all = instance->icon_full_change > back->frame;
+	const bool damage_all = instance->icon_full_change > front_frame
+		|| ! instance->icon_buffer_attached;
+	if (redraw_all)
+		clear_buffer(cairo);
+
+	struct Lava_item *item;
+	wl_list_for_each(item, &instance->bar->items, link)
+	{
+		struct Lava_icon_slot *slot = &instance->icon_slots[item->index];
+		if ( redraw_all || slot->changed > back->frame )
+			draw_item(instance, cairo, item);
+		if ( ! damage_all && slot->changed > front_frame )
+		{
+			ubox_t box = item_buffer_box(instance, item);
+			wl_surface_damage_buffer(instance->icon_surface,
+					(int32_t)box.x, (int32_t)box.y,
+					(int32_t)box.w, (int32_t)box.h);
+		}
+	}
+
+	back->frame = ++instance->icon_frame;
 
 	wl_surface_set_buffer_scale(instance->icon_surface, (int32_t)scale);
-	wl_surface_attach(instance->icon_surface, instance->current_icon_buffer->buffer, 0, 0);
-	wl_surface_damage_buffer(instance->icon_surface, 0, 0, INT32_MAX, INT32_MAX);
+	swapchain_attach(&instance->icon_swapchain, instance->icon_surface);
+	if (damage_all)
+		wl_surface_damage_buffer(instance->icon_surface, 0, 0, INT32_MAX, INT32_MAX);
+	instance->icon_buffer_attached = true;
+	return true;
 }
 
-static void bar_instance_render_background_frame (struct Lava_bar_instance *instance)
+static struct Lava_swapchain *bar_instance_bar_swapchain (struct Lava_bar_instance *instance)
 {
-	struct Lava_bar_configuration *config = instance->config;
-	struct Lava_output            *output = instance->output;
-	uint32_t                       scale  = output->scale;
+	return instance->hidden ? &instance->bar_hidden_swapchain : &instance->bar_swapchain;
+}
+
+/* Returns false if no buffer was available to render into. */
+static bool bar_instance_render_background_frame (struct Lava_bar_instance *instance)
+{
+	struct Lava_bar_configuration *config    = instance->config;
+	struct Lava_output            *output    = instance->output;
+	struct Lava_swapchain         *swapchain = bar_instance_bar_swapchain(instance);
+	uint32_t                       scale     = output->scale;
 
 	ubox_t *buffer_dim, *bar_dim;
 	if (instance->hidden)
@@ -950,14 +1326,28 @@ static void bar_instance_render_background_frame (struct Lava_bar_instance *inst
 	else
 		buffer_dim = &instance->surface_dim, bar_dim = &instance->bar_dim;
 
+	const uint32_t w = buffer_dim->w * scale, h = buffer_dim->h * scale;
+
+	/* If the last buffer of this state is still up to date, it can simply
+	 * be attached again. It is never drawn to after being rendered, so it
+	 * does not matter whether the compositor still holds it.
+	 */
+	struct Lava_buffer *current = swapchain->current;
+	if ( current != NULL && current->buffer != NULL && current->w == w
+			&& current->h == h && current->frame == instance->bar_content )
+	{
+		log_message(2, "[bar] Bar frame unchanged: global_name=%d hidden=%d\n",
+				instance->output->global_name, instance->hidden);
+		goto attach;
+	}
+
 	log_message(2, "[bar] Render bar frame: global_name=%d\n", instance->output->global_name);
 
 	/* Get new/next buffer. */
-	if (! next_buffer(&instance->current_bar_buffer, context.shm, instance->bar_buffers,
-				buffer_dim->w  * scale, buffer_dim->h * scale))
-		return;
+	if (! swapchain_next_buffer(swapchain, context.shm, &output->shm_pool, w, h))
+		return false;
 
-	cairo_t *cairo = instance->current_bar_buffer->cairo;
+	cairo_t *cairo = swapchain->current->cairo;
 	clear_buffer(cairo);
 
 	cairo_set_antialias(cairo, CAIRO_ANTIALIAS_BEST);
@@ -970,9 +1360,13 @@ static void bar_instance_render_background_frame (struct Lava_bar_instance *inst
 				scale, &config->bar_colour, &config->border_colour);
 	}
 
+	swapchain->current->frame = instance->bar_content;
+
+attach:
 	wl_surface_set_buffer_scale(instance->bar_surface, (int32_t)scale);
-	wl_surface_attach(instance->bar_surface, instance->current_bar_buffer->buffer, 0, 0);
+	swapchain_attach(swapchain, instance->bar_surface);
 	wl_surface_damage_buffer(instance->bar_surface, 0, 0, INT32_MAX, INT32_MAX);
+	return true;
 }
 
 static uint32_t get_anchor (struct Lava_bar_configuration *config)
@@ -1026,9 +1420,7 @@ static uint32_t get_anchor (struct Lava_bar_configuration *config)
 static void bar_instance_configure_layer_surface (struct Lava_bar_instance *instance)
 {
 	struct Lava_bar_configuration *config = instance->config;
-
-	log_message(1, "[bar] Configuring bar instance: global_name=%d\n",
-			instance->output->global_name);
+	struct Lava_surface_state     *sent   = &instance->sent;
 
 	ubox_t *buffer_dim, *bar_dim;
 	if (instance->hidden)
@@ -1036,23 +1428,17 @@ static void bar_instance_configure_layer_surface (struct Lava_bar_instance *inst
 	else
 		buffer_dim = &instance->surface_dim, bar_dim = &instance->bar_dim;
 
-	zwlr_layer_surface_v1_set_size(instance->layer_surface, buffer_dim->w, buffer_dim->h);
-
 	/* Anchor the surface to the correct edge. */
-	zwlr_layer_surface_v1_set_anchor(instance->layer_surface, get_anchor(config));
+	const uint32_t anchor = get_anchor(config);
 
-	if ( config->mode == MODE_DEFAULT )
-		zwlr_layer_surface_v1_set_margin(instance->layer_surface,
-				(int32_t)config->margin.top, (int32_t)config->margin.right,
-				(int32_t)config->margin.bottom, (int32_t)config->margin.left);
-	else if ( config->orientation == ORIENTATION_HORIZONTAL )
-		zwlr_layer_surface_v1_set_margin(instance->layer_surface,
-				(int32_t)config->margin.top, 0,
-				(int32_t)config->margin.bottom, 0);
-	else
-		zwlr_layer_surface_v1_set_margin(instance->layer_surface,
-				0, (int32_t)config->margin.right,
-				0, (int32_t)config->margin.left);
+	udirections_t margin = config->margin;
+	if ( config->mode != MODE_DEFAULT )
+	{
+		if ( config->orientation == ORIENTATION_HORIZONTAL )
+			margin.left = margin.right = 0;
+		else
+			margin.top = margin.bottom = 0;
+	}
 
 	/* Set exclusive zone to prevent other surfaces from obstructing ours. */
 	int32_t exclusive_zone;
@@ -1065,29 +1451,85 @@ static void bar_instance_configure_layer_surface (struct Lava_bar_instance *inst
 	}
 	else
 		exclusive_zone = config->exclusive_zone;
-	zwlr_layer_surface_v1_set_exclusive_zone(instance->layer_surface,
-			exclusive_zone);
-
-	if ( context.need_keyboard == true )
-		zwlr_layer_surface_v1_set_keyboard_interactivity(instance->layer_surface,
-				ZWLR_LAYER_SURFACE_V1_KEYBOARD_INTERACTIVITY_ON_DEMAND);
 
-	/* Create a region of the visible part of the surface.
+	/* Region of the visible part of the surface.
 	 * Behold: In MODE_AGGRESSIVE, the actual surface is larger than the visible bar.
 	 */
-	struct wl_region *region = wl_compositor_create_region(context.compositor);
-	wl_region_add(region, (int32_t)instance->bar_dim.x, (int32_t)instance->bar_dim.y,
-			(int32_t)bar_dim->w, (int32_t)bar_dim->h);
+	ubox_t input_region = {
+		.x = instance->bar_dim.x,
+		.y = instance->bar_dim.y,
+		.w = bar_dim->w,
+		.h = bar_dim->h
+	};
+
+	/* Every request changes compositor side state, which may lead to the
+	 * surfaces being re-arranged and a new configure event, so only the
+	 * ones which actually change something are sent.
+	 */
+	const bool all = ! sent->layer_surface_set;
+	if ( ! all && sent->w == buffer_dim->w && sent->h == buffer_dim->h
+			&& sent->anchor == anchor
+			&& udirections_t_equal(&sent->margin, &margin)
+			&& sent->exclusive_zone == exclusive_zone
+			&& sent->keyboard_interactivity == context.need_keyboard
+			&& ubox_t_equal(&sent->input_region, &input_region) )
+		return;
+
+	log_message(1, "[bar] Configuring bar instance: global_name=%d\n",
+			instance->output->global_name);
+
+	if ( all || sent->w != buffer_dim->w || sent->h != buffer_dim->h )
+	{
+		zwlr_layer_surface_v1_set_size(instance->layer_surface, buffer_dim->w, buffer_dim->h);
+		sent->w = buffer_dim->w, sent->h = buffer_dim->h;
+	}
+
+	if ( all || sent->anchor != anchor )
+	{
+		zwlr_layer_surface_v1_set_anchor(instance->layer_surface, anchor);
+		sent->anchor = anchor;
+	}
+
+	if ( all || ! udirections_t_equal(&sent->margin, &margin) )
+	{
+		zwlr_layer_surface_v1_set_margin(instance->layer_surface,
+				(int32_t)margin.top, (int32_t)margin.right,
+				(int32_t)margin.bottom, (int32_t)margin.left);
+		sent->margin = margin;
+	}
+
+	if ( all || sent->exclusive_zone != exclusive_zone )
+	{
+		zwlr_layer_surface_v1_set_exclusive_zone(instance->layer_surface,
+				exclusive_zone);
+		sent->exclusive_zone = exclusive_zone;
+	}
+
+	/* Keyboard interactivity defaults to none. */
+	if ( sent->keyboard_interactivity != context.need_keyboard )
+	{
+		zwlr_layer_surface_v1_set_keyboard_interactivity(instance->layer_surface,
+				context.need_keyboard ? ZWLR_LAYER_SURFACE_V1_KEYBOARD_INTERACTIVITY_ON_DEMAND
+				: ZWLR_LAYER_SURFACE_V1_KEYBOARD_INTERACTIVITY_NONE);
+		sent->keyboard_interactivity = context.need_keyboard;
+	}
 
 	/* Set input region. This is necessary to prevent the unused parts of
 	 * the surface to catch pointer and touch events.
 	 */
-	wl_surface_set_input_region(instance->bar_surface, region);
+	if ( all || ! ubox_t_equal(&sent->input_region, &input_region) )
+	{
+		struct wl_region *region = wl_compositor_create_region(context.compositor);
+		wl_region_add(region, (int32_t)input_region.x, (int32_t)input_region.y,
+				(int32_t)input_region.w, (int32_t)input_region.h);
+		wl_surface_set_input_region(instance->bar_surface, region);
+		wl_region_destroy(region);
+		sent->input_region = input_region;
+	}
 
-	wl_region_destroy(region);
+	sent->layer_surface_set = true;
 }
 
-
 static void layer_surface_handle_configure (void *data,
 		struct zwlr_layer_surface_v1 *surface, uint32_t serial,
 		uint32_t w, uint32_t h)
@@ -1100,7 +1542,7 @@ static void layer_surface_handle_configure (void *data,
 	// TODO respect new size
 	instance->configured = true;
 	zwlr_layer_surface_v1_ack_configure(surface, serial);
-	update_bar_instance(instance, true, false);
+	update_bar_instance(instance, BAR_UPDATE_CONFIGURE);
 }
 
 static void layer_surface_handle_closed (void *data, struct zwlr_layer_surface_v1 *surface)
@@ -1118,17 +1560,29 @@ static const struct zwlr_layer_surface_v1_listener layer_surface_listener = {
 
 static void bar_instance_configure_subsurface (struct Lava_bar_instance *instance)
 {
+	struct Lava_surface_state *sent = &instance->sent;
+	const int32_t x = (int32_t)instance->item_area_dim.x;
+	const int32_t y = (int32_t)instance->item_area_dim.y;
+
+	if ( sent->subsurface_set && sent->subsurface_x == x && sent->subsurface_y == y )
+		return;
+
 	log_message(1, "[bar] Configuring icons: global_name=%d\n", instance->output->global_name);
 
-	wl_subsurface_set_position(instance->subsurface,
-			(int32_t)instance->item_area_dim.x, (int32_t)instance->item_area_dim.y);
+	wl_subsurface_set_position(instance->subsurface, x, y);
+	sent->subsurface_x = x, sent->subsurface_y = y;
 
 	/* We do not want to receive any input events from the subsurface.
 	 * Almot everything in LavaLauncher uses the coords of the parent surface.
+	 * The empty input region never changes, so it is only set once.
 	 */
-	struct wl_region *region = wl_compositor_create_region(context.compositor);
-	wl_surface_set_input_region(instance->icon_surface, region);
-	wl_region_destroy(region);
+	if (! sent->subsurface_set)
+	{
+		struct wl_region *region = wl_compositor_create_region(context.compositor);
+		wl_surface_set_input_region(instance->icon_surface, region);
+		wl_region_destroy(region);
+		sent->subsurface_set = true;
+	}
 }
 
 /* Positions and dimensions for MODE_AGGRESSIVE. */
@@ -1329,14 +1783,20 @@ static void bar_instance_mode_default_dimensions (struct Lava_bar_instance *inst
 	instance->surface_hidden_dim = instance->bar_hidden_dim;
 }
 
-static void bar_instance_update_dimensions (struct Lava_bar_instance *instance)
+/* Returns whether the dimensions of the bar or its surface have changed. */
+static bool bar_instance_update_dimensions (struct Lava_bar_instance *instance)
 {
 	struct Lava_bar_configuration *config  = instance->config;
 	struct Lava_bar               *bar     = instance->bar;
 	struct Lava_output            *output  = instance->output;
 
 	if ( output->w == 0 || output->h == 0 )
-		return;
+		return false;
+
+	ubox_t surface_dim        = instance->surface_dim;
+	ubox_t surface_hidden_dim = instance->surface_hidden_dim;
+	ubox_t bar_dim            = instance->bar_dim;
+	ubox_t bar_hidden_dim     = instance->bar_hidden_dim;
 
 	/* Size of item area. */
 	if ( config->orientation == ORIENTATION_HORIZONTAL )
@@ -1357,6 +1817,11 @@ static void bar_instance_update_dimensions (struct Lava_bar_instance *instance)
 		case MODE_FULL:       bar_instance_mode_full_dimensions(instance);       break;
 		case MODE_AGGRESSIVE: bar_instance_mode_aggressive_dimensions(instance); break;
 	}
+
+	return ! ubox_t_equal(&surface_dim, &instance->surface_dim)
+		|| ! ubox_t_equal(&surface_hidden_dim, &instance->surface_hidden_dim)
+		|| ! ubox_t_equal(&bar_dim, &instance->bar_dim)
+		|| ! ubox_t_equal(&bar_hidden_dim, &instance->bar_hidden_dim);
 }
 
 /* Return a bool indicating if the bar instance should currently be hidden or not. */
@@ -1393,6 +1858,26 @@ bool create_bar_instance (struct Lava_bar *bar, struct Lava_bar_configuration *c
 	instance->subsurface    = NULL;
 	instance->configured    = false;
 	instance->hover         = false;
+	instance->icon_atlas    = NULL;
+
+	instance->icon_atlas_direct    = false;
+	instance->icon_buffer_attached = false;
+	instance->frame_callback       = NULL;
+	memset(&instance->sent, 0, sizeof(struct Lava_surface_state));
+	instance->pending_updates      = 0;
+	init_swapchain(&instance->bar_swapchain, context.swapchain_depth);
+	init_swapchain(&instance->bar_hidden_swapchain, context.swapchain_depth);
+	instance->bar_content          = 1;
+	instance->bar_content_scale    = output->scale;
+	instance->bar_content_config   = config;
+	init_swapchain(&instance->icon_swapchain, context.swapchain_depth);
+	instance->icon_slots           = NULL;
+	instance->icon_slot_amount     = 0;
+	instance->icon_frame           = 0;
+	instance->icon_full_change     = 0;
+	instance->icon_last_change     = 0;
+	instance->icon_frame_w         = 0;
+	instance->icon_frame_h         = 0;
 	instance->hidden        = bar_instance_should_hide(instance);
 
 	wl_list_init(&instance->indicators);
@@ -1442,6 +1927,13 @@ void destroy_bar_instance (struct Lava_bar_instance *instance)
 	if ( instance == NULL )
 		return;
 
+	/* Make sure no seat refers to this instance anymore. */
+	seats_forget_items(instance);
+	struct Lava_seat *seat;
+	wl_list_for_each(seat, &context.seats, link)
+		if ( seat->pointer.instance == instance )
+			seat->pointer.instance = NULL;
+
 	struct Lava_item_indicator *indicator, *temp;
 	wl_list_for_each_safe(indicator, temp, &instance->indicators, link)
 		destroy_indicator(indicator);
@@ -1451,10 +1943,13 @@ void destroy_bar_instance (struct Lava_bar_instance *instance)
 	DESTROY(instance->bar_surface, wl_surface_destroy);
 	DESTROY(instance->icon_surface, wl_surface_destroy);
 
-	finish_buffer(&instance->bar_buffers[0]);
-	finish_buffer(&instance->bar_buffers[1]);
-	finish_buffer(&instance->icon_buffers[0]);
-	finish_buffer(&instance->icon_buffers[1]);
+	DESTROY(instance->frame_callback, wl_callback_destroy);
+	finish_swapchain(&instance->bar_swapchain);
+	finish_swapchain(&instance->bar_hidden_swapchain);
+	finish_swapchain(&instance->icon_swapchain);
+	finish_indicator_sprites(instance);
+	DESTROY(instance->icon_atlas, cairo_surface_destroy);
+	free_if_set(instance->icon_slots);
 
 	wl_list_remove(&instance->link);
 	free(instance);
@@ -1468,19 +1963,90 @@ void destroy_all_bar_instances (struct Lava_output *output)
 		destroy_bar_instance(instance);
 }
 
-void update_bar_instance (struct Lava_bar_instance *instance, bool need_new_dimensions,
-		bool only_update_on_hide_change)
+/* The swapchain depth is a global setting, so a reload changing it affects the
+ * instances of all bars, including unchanged ones. Buffers the compositor
+ * still holds are kept by the shared memory pool until they are released.
+ */
+void bar_instances_set_swapchain_depth (void)
+{
+	log_message(1, "[bar] Changing swapchain depth: depth=%d\n", context.swapchain_depth);
+	struct Lava_output *output;
+	struct Lava_bar_instance *instance;
+	wl_list_for_each(output, &context.outputs, link)
+		wl_list_for_each(instance, &output->bar_instances, link)
+		{
+			finish_swapchain(&instance->bar_swapchain);
+			finish_swapchain(&instance->bar_hidden_swapchain);
+			finish_swapchain(&instance->icon_swapchain);
+			init_swapchain(&instance->bar_swapchain, context.swapchain_depth);
+			init_swapchain(&instance->bar_hidden_swapchain, context.swapchain_depth);
+			init_swapchain(&instance->icon_swapchain, context.swapchain_depth);
+
+			/* Nothing of the new buffers can be reused. */
+			instance->icon_buffer_attached = false;
+			instance->icon_full_change     = instance->icon_frame + 1;
+			instance->icon_last_change     = instance->icon_full_change;
+			update_bar_instance(instance, BAR_UPDATE_DIMENSIONS);
+		}
+}
+
+static void frame_callback_handle_done (void *data, struct wl_callback *callback,
+		uint32_t time)
+{
+	struct Lava_bar_instance *instance = (struct Lava_bar_instance *)data;
+
+	/* Pending updates are done on the next flush. */
+	wl_callback_destroy(instance->frame_callback);
+	instance->frame_callback = NULL;
+}
+
+static const struct wl_callback_listener frame_callback_listener = {
+	.done = frame_callback_handle_done,
+};
+
+/* Render and commit all pending changes of a bar instance. Renders are paced
+ * by frame callbacks, so there is at most one per compositor frame.
+ */
+static void bar_instance_next_frame (struct Lava_bar_instance *instance)
 {
-	/* It is possible that this function is called by output events before
-	 * the bar instance has been created. This function will return and
-	 * abort unless it is called either when a surface configure event has
-	 * been received at least once, it is called by a surface configure
-	 * event or it is called during the creation of the surface.
+	bar_instance_configure_subsurface(instance);
+	bar_instance_configure_layer_surface(instance);
+
+	bar_instance_update_indicator_sprites(instance);
+	bool rendered = bar_instance_render_icon_frame(instance);
+	rendered = bar_instance_render_background_frame(instance) && rendered;
+
+	/* If the compositor holds all buffers, the frame is rendered again on
+	 * the first flush after it released one, instead of waiting for a
+	 * frame callback.
 	 */
-	if ( instance == NULL || ! instance->configured )
+	if (! rendered)
+		instance->pending_updates |= BAR_UPDATE_DIMENSIONS;
+
+	/* The compositor only sends frame callbacks for mapped surfaces. */
+	struct Lava_buffer *buffer = bar_instance_bar_swapchain(instance)->current;
+	if ( rendered && buffer != NULL && buffer->buffer != NULL )
+	{
+		instance->frame_callback = wl_surface_frame(instance->bar_surface);
+		wl_callback_add_listener(instance->frame_callback,
+				&frame_callback_listener, instance);
+	}
+
+	wl_surface_commit(instance->icon_surface);
+	wl_surface_commit(instance->bar_surface);
+}
+
+/* Remember that a bar instance needs to be updated. All updates are merged
+ * and done at most once per frame by flush_bar_instance_updates().
+ */
+void update_bar_instance (struct Lava_bar_instance *instance, enum Bar_update update)
+{
+	if ( instance == NULL )
 		return;
 
-	/* An instance with no fitting configuration must be destroyed. */
+	/* An instance with no fitting configuration must be destroyed. This
+	 * can not wait, as input events may arrive before the next flush.
+	 */
 	if ( instance->config == NULL )
 	{
 		log_message(2, "[bar] No configuration set, destroying bar: global-name=%d\n",
@@ -1489,29 +2055,68 @@ void update_bar_instance (struct Lava_bar_instance *instance, bool need_new_dime
 		return;
 	}
 
-	if (need_new_dimensions)
-		bar_instance_update_dimensions(instance);
+	instance->pending_updates |= update;
+}
+
+static void bar_instance_flush_updates (struct Lava_bar_instance *instance)
+{
+	/* It is possible that updates are requested by output events before
+	 * the surface has been configured. They are kept until it is.
+	 */
+	if ( instance->pending_updates == 0 || ! instance->configured )
+		return;
+
+	/* Wait for the compositor to be ready for the next frame, unless the
+	 * surface was configured. The callback of the previous frame is then
+	 * outdated by the new commit.
+	 */
+	if ( instance->frame_callback != NULL )
+	{
+		if (! (instance->pending_updates & BAR_UPDATE_CONFIGURE))
+			return;
+		DESTROY_NULL(instance->frame_callback, wl_callback_destroy);
+	}
+
+	const uint32_t updates = instance->pending_updates;
+	instance->pending_updates = 0;
+
+	/* Both cached bar buffers are outdated by a change of dimensions, scale
+	 * or configuration set, but not by a configure confirming the size.
+	 */
+	if ( ( updates & BAR_UPDATE_DIMENSIONS )
+			&& ( bar_instance_update_dimensions(instance)
+				|| instance->bar_content_scale  != instance->output->scale
+				|| instance->bar_content_config != instance->config ) )
+	{
+		instance->bar_content++;
+		instance->bar_content_scale  = instance->output->scale;
+		instance->bar_content_config = instance->config;
+	}
 
 	const bool currently_hidden = instance->hidden;
 	instance->hidden = bar_instance_should_hide(instance);
-	if ( only_update_on_hide_change && ( currently_hidden == instance->hidden ) )
+	if ( ! (updates & (BAR_UPDATE_DIMENSIONS | BAR_UPDATE_CONFIGURE))
+			&& currently_hidden == instance->hidden )
 		return;
 
-	bar_instance_configure_subsurface(instance);
-	bar_instance_configure_layer_surface(instance);
-
-	bar_instance_render_icon_frame(instance);
-	bar_instance_render_background_frame(instance);
+	bar_instance_next_frame(instance);
+}
 
-	wl_surface_commit(instance->icon_surface);
-	wl_surface_commit(instance->bar_surface);
+/* Called right before the Wayland connection is flushed. */
+void flush_bar_instance_updates (void)
+{
+	struct Lava_output *output;
+	struct Lava_bar_instance *instance;
+	wl_list_for_each(output, &context.outputs, link)
+		wl_list_for_each(instance, &output->bar_instances, link)
+			bar_instance_flush_updates(instance);
 }
 
 /* Call this to handle all changes to a bar instance when it is entered by a pointer. */
 void bar_instance_pointer_enter (struct Lava_bar_instance *instance)
 {
 	instance->hover = true;
-	update_bar_instance(instance, false, true);
+	update_bar_instance(instance, BAR_UPDATE_HIDDEN);
 }
 
 /* Call this to handle all changes to a bar instance when it is left by a pointer. */
@@ -1527,7 +2132,7 @@ void bar_instance_pointer_leave (struct Lava_bar_instance *instance)
 
 
 	instance->hover = false;
-	update_bar_instance(instance, false, true);
+	update_bar_instance(instance, BAR_UPDATE_HIDDEN);
 }
 
 struct Lava_bar_instance *bar_instance_from_surface (struct wl_surface *surface)
@@ -27,6 +27,7 @@
 #include"types/colour_t.h"
 #include"types/box_t.h"
 #include"types/buffer.h"
+#include"draw.h"
 
 struct Lava_item;
 
@@ -65,11 +66,36 @@ enum Condition_resolution
 	RESOLUTION_ALL
 };
 
-enum Item_indicator_style
+enum Indicator_state
 {
-	STYLE_RECTANGLE,
-	STYLE_ROUNDED_RECTANGLE,
-	STYLE_CIRCLE
+	INDICATOR_HOVER,
+	INDICATOR_ACTIVE
+};
+
+/* A pre-rendered indicator image, shared by all indicators of a bar instance. */
+struct Lava_indicator_sprite
+{
+	struct Lava_buffer        buffer;
+	enum Item_indicator_style style;
+	uint32_t                  size;
+	colour_t                  colour;
+	uradii_t                  radii;
+	bool                      valid;
+};
+
+/* Reasons for which a bar instance needs to be updated. */
+enum Bar_update
+{
+	/* Output, configuration set or surface changed; Redraw everything. */
+	BAR_UPDATE_DIMENSIONS = 1 << 0,
+
+	/* Something the hidden state depends on changed; Only redraw if it did. */
+	BAR_UPDATE_HIDDEN     = 1 << 1,
+
+	/* The surface was configured; The commit acknowledging it must not
+	 * wait for a frame callback.
+	 */
+	BAR_UPDATE_CONFIGURE  = 1 << 2
 };
 
 enum Hidden_mode
@@ -139,6 +165,31 @@ struct Lava_bar_configuration
 	enum Condition_resolution condition_resolution;
 };
 
+/* State of one item on the icon surface of a bar instance. */
+struct Lava_icon_slot
+{
+	uint32_t     ordinate, length;
+	unsigned int atlas_slot;
+	bool         has_icon;
+	uint64_t     changed;
+};
+
+/* Last state sent to the compositor for the surfaces of a bar instance. Only
+ * requests which change it are sent again.
+ */
+struct Lava_surface_state
+{
+	bool          layer_surface_set;
+	uint32_t      w, h, anchor;
+	udirections_t margin;
+	int32_t       exclusive_zone;
+	bool          keyboard_interactivity;
+	ubox_t        input_region;
+
+	bool          subsurface_set;
+	int32_t       subsurface_x, subsurface_y;
+};
+
 /* This struct corresponds to one instance of a bar. */
 struct Lava_bar_instance
 {
@@ -160,13 +211,49 @@ struct Lava_bar_instance
 
 	bool hidden, hover;
 
-	struct Lava_buffer  bar_buffers[2];
-	struct Lava_buffer *current_bar_buffer;
+	struct Lava_surface_state sent;
 
-	struct Lava_buffer  icon_buffers[2];
-	struct Lava_buffer *current_icon_buffer;
+	/* The bar surface has one swapchain for each hidden state, so hiding
+	 * and unhiding only needs to re-attach an already rendered buffer. The
+	 * frame of their buffers is the bar_content generation they show. It
+	 * only changes with the dimensions, scale or configuration set.
+	 */
+	struct Lava_swapchain          bar_swapchain;
+	struct Lava_swapchain          bar_hidden_swapchain;
+	uint64_t                       bar_content;
+	uint32_t                       bar_content_scale;
+	struct Lava_bar_configuration *bar_content_config;
+
+	struct Lava_swapchain icon_swapchain;
+	bool                  icon_buffer_attached;
+
+	/* Updates are only remembered as a set of enum Bar_update flags and
+	 * done together right before the Wayland connection is flushed. While a
+	 * frame callback is pending, they are delayed until it is done.
+	 */
+	struct wl_callback *frame_callback;
+	uint32_t            pending_updates;
+
+	/* State of the icons on the icon surface, used to only redraw and
+	 * damage what has changed. The changes are tracked by the number of the
+	 * frame in which they first need to be drawn.
+	 */
+	struct Lava_icon_slot *icon_slots;
+	int                    icon_slot_amount;
+	uint64_t               icon_frame, icon_full_change, icon_last_change;
+	uint32_t               icon_frame_w, icon_frame_h;
+
+	/* Icons rasterized for the scale, size and icon padding they were
+	 * created with, in rows of cells. When there are too many icons for
+	 * an atlas, they are drawn directly instead.
+	 */
+	cairo_surface_t *icon_atlas;
+	bool             icon_atlas_direct;
+	uint32_t         icon_atlas_scale, icon_atlas_size, icon_atlas_padding;
+	uint32_t         icon_atlas_columns;
 
 	struct wl_list indicators;
+	struct Lava_indicator_sprite indicator_sprites[2];
 
 	bool configured;
 };
@@ -181,8 +268,10 @@ struct Lava_item_indicator
 
 	struct wl_surface    *indicator_surface;
 	struct wl_subsurface *indicator_subsurface;
-	struct Lava_buffer    indicator_buffers[2];
-	struct Lava_buffer   *current_indicator_buffer;
+	enum Indicator_state  state;
+
+	/* Whether the indicator is currently used by a seat or touchpoint. */
+	bool in_use;
 };
 
 /* This struct is a logical bar, which can have multiple configuration sets and
@@ -195,6 +284,14 @@ struct Lava_bar
 	struct wl_list    items;
 	struct Lava_item *last_item;
 	int               item_amount;
+	unsigned int      atlas_slots;
+
+	/* Flat array of the items in order and the index of the item at every
+	 * ordinate of the item area, for constant time hit-testing.
+	 */
+	struct Lava_item **item_array;
+	uint16_t          *item_at_ordinate;
+	unsigned int       item_length_sum;
 
 	/* The different configurations of the bar. The first one is treated as default. */
 	struct Lava_bar_configuration *current_config, *default_config, *last_config;
@@ -207,23 +304,26 @@ struct Lava_bar_configuration *get_bar_config_for_output (struct Lava_bar *bar,
 bool create_bar (void);
 bool finalize_bar (struct Lava_bar *bar);
 void destroy_all_bars (void);
+void replace_bars (struct wl_list *old_bars);
 bool bar_config_set_variable (struct Lava_bar_configuration *config,
 		const char *variable, const char *value, int line);
 
 bool create_bar_instance (struct Lava_bar *bar, struct Lava_bar_configuration *config, struct Lava_output *output);
 void destroy_bar_instance (struct Lava_bar_instance *instance);
 void destroy_all_bar_instances (struct Lava_output *output);
-void update_bar_instance (struct Lava_bar_instance *instance, bool need_new_dimensions,
-		bool only_update_on_hide_change);
+void bar_instances_set_swapchain_depth (void);
+void update_bar_instance (struct Lava_bar_instance *instance, enum Bar_update update);
+void flush_bar_instance_updates (void);
 struct Lava_bar_instance *bar_instance_from_surface (struct wl_surface *surface);
 struct Lava_bar_instance *bar_instance_from_bar (struct Lava_bar *bar, struct Lava_output *output);
 void bar_instance_pointer_leave (struct Lava_bar_instance *instance);
 void bar_instance_pointer_enter (struct Lava_bar_instance *instance);
 
 void destroy_indicator (struct Lava_item_indicator *indicator);
-struct Lava_item_indicator *create_indicator (struct Lava_bar_instance *instance);
+struct Lava_item_indicator *take_indicator (struct Lava_bar_instance *instance);
+void release_indicator (struct Lava_item_indicator *indicator);
 void move_indicator (struct Lava_item_indicator *indicator, struct Lava_item *item);
-void indicator_set_colour (struct Lava_item_indicator *indicator, colour_t *colour);
+void indicator_set_state (struct Lava_item_indicator *indicator, enum Indicator_state state);
 void indicator_commit (struct Lava_item_indicator *indicator);
 
 #endif
@@ -17,17 +17,29 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include<stdio.h>
 #include<stdlib.h>
 #include<stdbool.h>
 #include<errno.h>
 #include<string.h>
 #include<ctype.h>
+#include<unistd.h>
+#include<fcntl.h>
+#include<sys/mman.h>
+#include<sys/stat.h>
+#include<signal.h>
+#include<setjmp.h>
+#include<wayland-server.h>
 
 #include"lavalauncher.h"
 #include"str.h"
 #include"item.h"
 #include"bar.h"
+#include"snapshot.h"
+#include"types/image_t.h"
+#include"types/buffer.h"
 
 bool is_boolean_true (const char *str)
 {
@@ -53,16 +65,92 @@ bool set_boolean (bool *b, const char *value)
 	return true;
 }
 
+/* Global settings are parsed into this copy and only applied to the context
+ * once the entire configuration file has been parsed successfully.
+ */
+static struct
+{
+	int swapchain_depth;
+#ifdef WATCH_CONFIG
+	bool watch;
+#endif
+#if SVG_SUPPORT
+	bool svg_cache;
+#endif
+} parsed_globals;
+
+/* Every parse starts from the defaults, so that a setting removed from the
+ * config file is reset on reload instead of keeping its old value.
+ */
+static void parsed_globals_reset (void)
+{
+	parsed_globals.swapchain_depth = SWAPCHAIN_DEFAULT_DEPTH;
+#ifdef WATCH_CONFIG
+	parsed_globals.watch           = false;
+#endif
+#if SVG_SUPPORT
+	parsed_globals.svg_cache       = false;
+#endif
+}
+
+/* Stage global settings loaded from somewhere other than the config file,
+ * like a snapshot of it. Settings this build does not support are ignored.
+ */
+void stage_global_settings (int swapchain_depth, bool watch, bool svg_cache)
+{
+	parsed_globals.swapchain_depth = swapchain_depth;
+#ifdef WATCH_CONFIG
+	parsed_globals.watch           = watch;
+#endif
+#if SVG_SUPPORT
+	parsed_globals.svg_cache       = svg_cache;
+#endif
+}
+
+void apply_global_settings (void)
+{
+	context.swapchain_depth = parsed_globals.swapchain_depth;
+#ifdef WATCH_CONFIG
+	context.watch           = parsed_globals.watch;
+#endif
+#if SVG_SUPPORT
+	context.svg_cache       = parsed_globals.svg_cache;
+#endif
+}
+
 static bool global_set_watch (const char *arg)
 {
 #ifdef WATCH_CONFIG
-	return set_boolean(&context.watch, arg);
+	return set_boolean(&parsed_globals.watch, arg);
 #else
 	log_message(0, "WARNING: LavaLauncher has been compiled without the ability to watch the configuration file for changes.\n");
 	return true;
 #endif
 }
 
+static bool global_set_svg_cache (const char *arg)
+{
+#if SVG_SUPPORT
+	return set_boolean(&parsed_globals.svg_cache, arg);
+#else
+	log_message(0, "WARNING: LavaLauncher has been compiled without SVG support.\n");
+	return true;
+#endif
+}
+
+static bool global_set_swapchain_depth (const char *arg)
+{
+	int depth = atoi(arg);
+	if ( depth < SWAPCHAIN_MIN_DEPTH || depth > SWAPCHAIN_MAX_DEPTH )
+	{
+		log_message(0, "ERROR: Swapchain depth must be between %d and %d.\n",
+				SWAPCHAIN_MIN_DEPTH, SWAPCHAIN_MAX_DEPTH);
+		return false;
+	}
+	parsed_globals.swapchain_depth = depth;
+	return true;
+}
+
 bool global_set_variable (const char *variable, const char *value, int line)
 {
 	struct
@@ -70,7 +158,9 @@ bool global_set_variable (const char *variable, const char *value, int line)
 		const char *variable;
 		bool (*set)(const char*);
 	} configs[] = {
-		{ .variable = "watch-config-file", .set = global_set_watch }
+		{ .variable = "watch-config-file", .set = global_set_watch           },
+		{ .variable = "svg-cache",         .set = global_set_svg_cache       },
+		{ .variable = "swapchain-depth",   .set = global_set_swapchain_depth }
 	};
 
 	FOR_ARRAY(configs, i) if (! strcmp(configs[i].variable, variable))
@@ -105,47 +195,76 @@ enum Parser_context
 	CONTEXT_SPACER
 };
 
+/* Scratch buffer for names and values. It is reused for every string and only
+ * grows, so parsing does not allocate once it is large enough.
+ */
+struct Parser_buffer
+{
+	char  *data;
+	size_t length, capacity;
+};
+
 struct Parser
 {
-	FILE *file;
+	/* The config file is mapped and read in a single forward pass. */
+	const char *data;
+	size_t      size, position;
 	int line;
 
 	enum Parser_state   state;
 	enum Parser_context context;
 
-	char name_buffer[1024];
-	size_t name_buffer_length;
-	char value_buffer[1024];
-	size_t value_buffer_length;
+	struct Parser_buffer name;
+	struct Parser_buffer value;
 };
 
-static bool parser_get_char (struct Parser *parser, char *ch)
-{
-	errno = 0;
-	*ch = (char)fgetc(parser->file);
+/* The config file may be truncated while it is mapped, for example by an
+ * editor saving it, in which case reading from the mapping raises SIGBUS.
+ * The handler only jumps back into parse_config_file() when the signal was
+ * raised by reading a character, never from within the setters, which may
+ * touch mappings of their own.
+ */
+static sigjmp_buf            parser_sigbus_jump;
+static struct sigaction      parser_old_sigbus_action;
+static volatile sig_atomic_t parser_reading = 0;
 
-	switch (*ch)
-	{
-		case EOF:
-			if ( errno != 0 )
-			{
-				log_message(0, "ERROR: fgetc: %s\n", strerror(errno));
-				return false;
-			}
-			*ch = '\0';
-			break;
+static void parser_handle_sigbus (int signum)
+{
+	if (parser_reading)
+		siglongjmp(parser_sigbus_jump, 1);
 
-		case '\n':
-			parser->line++;
-			break;
+	/* Not caused by the config file. Restore the previous action, which
+	 * is taken when the faulting access is executed again.
+	 */
+	sigaction(SIGBUS, &parser_old_sigbus_action, NULL);
+}
 
-		default:
-			break;
+static bool parser_get_char (struct Parser *parser, char *ch)
+{
+	if ( parser->position >= parser->size )
+	{
+		*ch = '\0';
+		return true;
 	}
 
+	/* Only while reading from the mapping may SIGBUS be jumped out of. */
+	parser_reading = 1;
+	*ch = ((volatile const char *)parser->data)[parser->position];
+	parser_reading = 0;
+	parser->position++;
+	if ( *ch == '\n' )
+		parser->line++;
+
 	return true;
 }
 
+/* Only used for characters ending a string, which are never newlines. */
+static void parser_unget_char (struct Parser *parser)
+{
+	if ( parser->position > 0 && parser->position <= parser->size )
+		parser->position--;
+}
+
 static bool parser_handle_eof (struct Parser *parser)
 {
 	if ( parser->state == STATE_EXPECT_NAME_OR_CB && parser->context == CONTEXT_NONE )
@@ -231,14 +350,29 @@ static bool parser_handle_semicolon (struct Parser *parser, const char ch)
 	return true;
 }
 
-static void buffer_add_char (char (*buffer)[1024], size_t *length, char ch)
+static bool buffer_add_char (struct Parser_buffer *buffer, char ch)
 {
-	(*buffer)[*length] = ch;
-	(*length)++;
-	(*buffer)[*length] = '\0';
+	/* Keep room for the terminating zero. */
+	if ( buffer->length + 2 > buffer->capacity )
+	{
+		size_t capacity = buffer->capacity == 0 ? 256 : buffer->capacity * 2;
+		char *data = realloc(buffer->data, capacity);
+		if ( data == NULL )
+		{
+			log_message(0, "ERROR: Can not allocate.\n");
+			return false;
+		}
+		buffer->data     = data;
+		buffer->capacity = capacity;
+	}
+
+	buffer->data[buffer->length] = ch;
+	buffer->length++;
+	buffer->data[buffer->length] = '\0';
+	return true;
 }
 
-static bool parser_string_handle_escape (struct Parser *parser, char (*buffer)[1024], size_t *length)
+static bool parser_string_handle_escape (struct Parser *parser, struct Parser_buffer *buffer)
 {
 	char ch;
 	if (! parser_get_char(parser, &ch))
@@ -251,44 +385,41 @@ static bool parser_string_handle_escape (struct Parser *parser, char (*buffer)[1
 	else if ( ch == 'v' )
 		ch = '\v';
 
-	buffer_add_char(buffer, length, ch);
-
-	return true;
+	return buffer_add_char(buffer, ch);
 }
 
-static void buffer_trim_whitespace (char (*buffer)[1024], size_t length)
+static void buffer_trim_whitespace (struct Parser_buffer *buffer)
 {
-	size_t i = length;
-	for (; isspace((*buffer)[i-1]); i--);
-	(*buffer)[i] = '\0';
+	while ( buffer->length > 0 && isspace(buffer->data[buffer->length-1]) )
+		buffer->length--;
+	buffer->data[buffer->length] = '\0';
 }
 
-static bool parser_get_string (struct Parser *parser, char (*buffer)[1024], size_t *length,
+static bool parser_get_string (struct Parser *parser, struct Parser_buffer *buffer,
 		const char last_ch, bool single_word)
 {
 	bool quoted;
+	buffer->length = 0;
 	if ( last_ch == '"' )
 	{
 		if (single_word)
 			goto unexpected_quote;
 
-		*length    = 0;
-		*buffer[0] = '\0';
-		quoted     = true;
+		/* Make sure the buffer holds a string even if it stays empty. */
+		if (! buffer_add_char(buffer, '\0'))
+			return false;
+		buffer->length = 0;
+		quoted         = true;
 	}
 	else
 	{
-		*buffer[0] = last_ch;
-		*buffer[1] = '\0';
-		*length    = 1;
-		quoted     = false;
+		if (! buffer_add_char(buffer, last_ch))
+			return false;
+		quoted = false;
 	}
 
 	for (char ch;;)
 	{
-		if ( *length >= sizeof(*buffer) - 1 )
-			goto overflow;
-
 		if (! parser_get_char(parser, &ch))
 			return false;
 
@@ -300,20 +431,21 @@ static bool parser_get_string (struct Parser *parser, char (*buffer)[1024], size
 				goto done;
 			if (! quoted)
 			{
-				if (! isspace((*buffer)[*length-1]))
-					buffer_add_char(buffer, length, ' ');
+				if ( ! isspace(buffer->data[buffer->length-1])
+						&& ! buffer_add_char(buffer, ' ') )
+					return false;
 				continue;
 			}
 		}
 		else if ( ch == '#' || ch == ';' )
 		{
 			if ( single_word || ! quoted )
-				goto done_seek;
+				goto done_unget;
 		}
 		else if ( ch == '=' )
 		{
 			if ( single_word && ! quoted )
-				goto done_seek;
+				goto done_unget;
 		}
 		else if ( ch == '"' )
 		{
@@ -322,30 +454,26 @@ static bool parser_get_string (struct Parser *parser, char (*buffer)[1024], size
 		}
 		else if ( ch == '\\' )
 		{
-			if (! parser_string_handle_escape(parser, buffer, length))
+			if (! parser_string_handle_escape(parser, buffer))
 					return false;
 			continue;
 		}
 
-		buffer_add_char(buffer, length, ch);
+		if (! buffer_add_char(buffer, ch))
+			return false;
 	}
 
-done_seek:
-	fseek(parser->file, -1, SEEK_CUR);
+done_unget:
+	parser_unget_char(parser);
 done:
-	(*buffer)[1024-1] = '\0';
 	if (! quoted)
-		buffer_trim_whitespace(buffer, *length);
+		buffer_trim_whitespace(buffer);
 	return true;
 
 unterm:
 	log_message(0, "ERROR: Unterminated string on line %d.\n", parser->line);
 	return false;
 
-overflow:
-	log_message(0, "ERROR: Buffer overflow due to too long string on line %d.\n", parser->line);
-	return false;
-
 unexpected_quote:
 	log_message(0, "ERROR: Unexpected quotes on line %d.\n", parser->line);
 	return false;
@@ -355,20 +483,19 @@ static bool parser_handle_string (struct Parser *parser, const char ch)
 {
 	if ( parser->state == STATE_EXPECT_NAME_OR_CB )
 	{
-		if (! parser_get_string(parser, &parser->name_buffer,
-					&parser->name_buffer_length, ch, true))
+		if (! parser_get_string(parser, &parser->name, ch, true))
 			return false;
 
 		/* Check if name is that of a context, which then should be entered. */
 		if ( parser->context == CONTEXT_NONE )
 		{
-			if (! strcmp(parser->name_buffer, "global-settings"))
+			if (! strcmp(parser->name.data, "global-settings"))
 			{
 				parser->context = CONTEXT_GLOBAL_SETTINGS;
 				parser->state = STATE_EXPECT_OB;
 				return true;
 			}
-			else if (! strcmp(parser->name_buffer, "bar"))
+			else if (! strcmp(parser->name.data, "bar"))
 			{
 				parser->context = CONTEXT_BAR;
 				parser->state = STATE_EXPECT_OB;
@@ -376,25 +503,25 @@ static bool parser_handle_string (struct Parser *parser, const char ch)
 			}
 			else
 			{
-				log_message(0, "ERROR: Unexpected '%s' on line %d.\n", parser->name_buffer, parser->line);
+				log_message(0, "ERROR: Unexpected '%s' on line %d.\n", parser->name.data, parser->line);
 				return false;
 			}
 		}
 		else if ( parser->context == CONTEXT_BAR )
 		{
-			if (! strcmp(parser->name_buffer, "config"))
+			if (! strcmp(parser->name.data, "config"))
 			{
 				parser->context = CONTEXT_CONFIG;
 				parser->state = STATE_EXPECT_OB;
 				return create_bar_config(context.last_bar, false);
 			}
-			if (! strcmp(parser->name_buffer, "button"))
+			if (! strcmp(parser->name.data, "button"))
 			{
 				parser->context = CONTEXT_BUTTON;
 				parser->state = STATE_EXPECT_OB;
 				return create_item(context.last_bar, TYPE_BUTTON);
 			}
-			else if (! strcmp(parser->name_buffer, "spacer"))
+			else if (! strcmp(parser->name.data, "spacer"))
 			{
 				parser->context = CONTEXT_SPACER;
 				parser->state = STATE_EXPECT_OB;
@@ -409,8 +536,7 @@ static bool parser_handle_string (struct Parser *parser, const char ch)
 	}
 	else if ( parser->state == STATE_EXPECT_VALUE )
 	{
-		if (! parser_get_string(parser, &parser->value_buffer,
-					&parser->value_buffer_length, ch, false))
+		if (! parser_get_string(parser, &parser->value, ch, false))
 			return false;
 
 		struct Lava_bar *last_bar = context.last_bar;
@@ -418,25 +544,25 @@ static bool parser_handle_string (struct Parser *parser, const char ch)
 		switch (parser->context)
 		{
 			case CONTEXT_GLOBAL_SETTINGS:
-				return global_set_variable(parser->name_buffer,
-						parser->value_buffer, parser->line);
+				return global_set_variable(parser->name.data,
+						parser->value.data, parser->line);
 
 			case CONTEXT_BAR:
 				/* Change settings of default configuration set. */
 				return bar_config_set_variable(last_bar->default_config,
-						parser->name_buffer, parser->value_buffer,
+						parser->name.data, parser->value.data,
 						parser->line);
 
 			case CONTEXT_CONFIG:
 				/* Change settings of latest configuration set. */
 				return bar_config_set_variable(last_bar->last_config,
-						parser->name_buffer, parser->value_buffer,
+						parser->name.data, parser->value.data,
 						parser->line);
 
 			case CONTEXT_BUTTON:
 			case CONTEXT_SPACER:
 				return item_set_variable(last_bar->last_item,
-						parser->name_buffer, parser->value_buffer,
+						parser->name.data, parser->value.data,
 						parser->line);
 
 			default:
@@ -450,22 +576,72 @@ static bool parser_handle_string (struct Parser *parser, const char ch)
 
 bool parse_config_file (void)
 {
+	/* Static, as the parser is modified between sigsetjmp() and a
+	 * possible siglongjmp().
+	 */
 	errno = 0;
-	struct Parser parser = {
-		.file    = NULL,
-		.line    = 1,
-		.context = CONTEXT_NONE,
-		.state   = STATE_EXPECT_NAME_OR_CB
+	static struct Parser parser;
+	parser = (struct Parser){
+		.data     = NULL,
+		.size     = 0,
+		.position = 0,
+		.line     = 1,
+		.context  = CONTEXT_NONE,
+		.state    = STATE_EXPECT_NAME_OR_CB,
+		.name     = { NULL, 0, 0 },
+		.value    = { NULL, 0, 0 }
 	};
-	if ( NULL == (parser.file = fopen(context.config_path, "r")) )
+	parsed_globals_reset();
+
+	int fd = open(context.config_path, O_RDONLY | O_CLOEXEC);
+	if ( fd == -1 )
 	{
 		log_message(0, "ERROR: Can not open config file \"%s\".\n"
-				"ERROR: fopen: %s\n",
+				"ERROR: open: %s\n",
 				context.config_path, strerror(errno));
 		return false;
 	}
 
-	bool ret = true;
+	struct stat stat;
+	if ( -1 == fstat(fd, &stat) )
+	{
+		log_message(0, "ERROR: fstat: %s\n", strerror(errno));
+		close(fd);
+		return false;
+	}
+
+	/* Empty files can not be mapped. */
+	void *map = NULL;
+	parser.size = (size_t)stat.st_size;
+	if ( parser.size > 0 )
+	{
+		map = mmap(NULL, parser.size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if ( map == MAP_FAILED )
+		{
+			log_message(0, "ERROR: Can not map config file \"%s\".\n"
+					"ERROR: mmap: %s\n",
+					context.config_path, strerror(errno));
+			close(fd);
+			return false;
+		}
+		parser.data = map;
+	}
+	close(fd);
+
+	struct sigaction sigbus_action = { .sa_handler = parser_handle_sigbus };
+	sigemptyset(&sigbus_action.sa_mask);
+	sigaction(SIGBUS, &sigbus_action, &parser_old_sigbus_action);
+
+	volatile bool ret = true;
+	if ( sigsetjmp(parser_sigbus_jump, 1) != 0 )
+	{
+		parser_reading = 0;
+		log_message(0, "ERROR: Config file \"%s\" changed while being read.\n",
+				context.config_path);
+		ret = false;
+		goto exit;
+	}
+
 	for(char ch;;)
 	{
 		if (! parser_get_char(&parser, &ch))
@@ -505,7 +681,82 @@ bool parse_config_file (void)
 	}
 
 exit:
-	fclose(parser.file);
+	sigaction(SIGBUS, &parser_old_sigbus_action, NULL);
+	if ( map != NULL )
+		munmap(map, parser.size);
+	free_if_set(parser.name.data);
+	free_if_set(parser.value.data);
+	if (ret)
+		apply_global_settings();
 	return ret;
 }
 
+/* Parse the configuration file again and apply the changes to the running bars
+ * without disconnecting from the Wayland server. If the new configuration
+ * contains errors, the old one is kept. Returns false if the changes can not be
+ * applied this way and a full reload is needed instead.
+ */
+bool reload_config_file (void)
+{
+	log_message(1, "[config] Reloading configuration file.\n");
+
+	struct wl_list old_bars;
+	wl_list_init(&old_bars);
+	wl_list_insert_list(&old_bars, &context.bars);
+	wl_list_init(&context.bars);
+	context.last_bar = NULL;
+
+	const bool need_keyboard     = context.need_keyboard;
+	const bool need_pointer      = context.need_pointer;
+	const bool need_touch        = context.need_touch;
+	const bool need_river_status = context.need_river_status;
+	const int  swapchain_depth   = context.swapchain_depth;
+#if WATCH_CONFIG
+	const bool watch             = context.watch;
+#endif
+	context.need_keyboard     = false;
+	context.need_pointer      = false;
+	context.need_touch        = false;
+	context.need_river_status = false;
+
+	bool parsed = load_config_snapshot() || parse_config_file();
+
+	/* Input devices and interfaces which were not needed so far have not
+	 * been bound, so in that case everything must be set up again.
+	 */
+	bool need_full_reload = parsed && (
+			( context.need_keyboard     && ! need_keyboard     ) ||
+			( context.need_pointer      && ! need_pointer      ) ||
+			( context.need_touch        && ! need_touch        ) ||
+			( context.need_river_status && ! need_river_status ) );
+
+#if WATCH_CONFIG
+	/* The inotify event source is only added to the event loop on startup. */
+	if ( parsed && context.watch != watch )
+		need_full_reload = true;
+#endif
+
+	context.need_keyboard     = need_keyboard;
+	context.need_pointer      = need_pointer;
+	context.need_touch        = need_touch;
+	context.need_river_status = need_river_status;
+
+	if ( ! parsed || need_full_reload )
+	{
+		if (! parsed)
+			log_message(0, "ERROR: Failed to reload configuration file; Keeping old configuration.\n");
+		else
+			log_message(1, "[config] New configuration needs a full reload.\n");
+		destroy_all_bars();
+		wl_list_insert_list(&context.bars, &old_bars);
+		image_t_cache_sweep();
+		return ! need_full_reload;
+	}
+
+	replace_bars(&old_bars);
+	if ( context.swapchain_depth != swapchain_depth )
+		bar_instances_set_swapchain_depth();
+	image_t_cache_sweep();
+	return true;
+}
+
@@ -25,7 +25,10 @@
 bool is_boolean_true (const char *str);
 bool is_boolean_false (const char *str);
 bool set_boolean (bool *b, const char *value);
+void stage_global_settings (int swapchain_depth, bool watch, bool svg_cache);
+void apply_global_settings (void);
 bool parse_config_file (void);
+bool reload_config_file (void);
 
 #endif
 
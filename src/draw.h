@@ -0,0 +1,48 @@
+/*
+ * LavaLauncher - A simple launcher panel for Wayland
+ *
+ * Copyright (C) 2020 - 2021 Leon Henrik Plickat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef LAVALAUNCHER_DRAW_H
+#define LAVALAUNCHER_DRAW_H
+
+#include<stdint.h>
+#include<cairo/cairo.h>
+
+#include"types/colour_t.h"
+#include"types/box_t.h"
+#include"types/image_t.h"
+
+enum Item_indicator_style
+{
+	STYLE_RECTANGLE,
+	STYLE_ROUNDED_RECTANGLE,
+	STYLE_CIRCLE
+};
+
+void clear_buffer (cairo_t *cairo);
+void draw_bar_background (cairo_t *cairo, ubox_t *_dim, udirections_t *_border, uradii_t *_radii,
+		uint32_t scale, colour_t *bar_colour, colour_t *border_colour);
+void draw_indicator (cairo_t *cairo, enum Item_indicator_style style, uint32_t size,
+		uradii_t *radii, colour_t *colour);
+void draw_item_icon (cairo_t *cairo, ubox_t *box, cairo_surface_t *atlas,
+		uint32_t atlas_x, uint32_t atlas_y, uint32_t cell, uint32_t padding);
+void draw_item_image (cairo_t *cairo, ubox_t *box, image_t *image,
+		uint32_t cell, uint32_t padding);
+
+#endif
+
@@ -17,104 +17,233 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include<stdbool.h>
 #include<stdlib.h>
 #include<stdint.h>
 #include<poll.h>
 #include<errno.h>
 #include<string.h>
+#include<time.h>
+#include<unistd.h>
+#include<sys/epoll.h>
 #include<wayland-client.h>
 
 #include"lavalauncher.h"
 #include"event-loop.h"
 #include"str.h"
 
-void event_loop_init (struct Lava_event_loop *loop)
+/* Monotonic time in nanoseconds. */
+uint64_t event_loop_now (void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+bool event_loop_init (struct Lava_event_loop *loop)
 {
-	loop->fd_count = 0;
+	loop->running      = false;
+	loop->ready        = NULL;
+	loop->ready_amount = 0;
 	wl_list_init(&loop->sources);
+
+	if ( -1 == (loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) )
+	{
+		log_message(0, "ERROR: Unable to open epoll fd.\n"
+				"ERROR: epoll_create1: %s\n", strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+static uint32_t epoll_events_from_poll_events (short events)
+{
+	uint32_t ret = 0;
+	if ( events & POLLIN )
+		ret |= EPOLLIN;
+	if ( events & POLLOUT )
+		ret |= EPOLLOUT;
+	return ret;
+}
+
+static bool event_loop_register_source (struct Lava_event_loop *loop,
+		struct Lava_event_source *source, int op)
+{
+	struct epoll_event event = {
+		.events   = epoll_events_from_poll_events(source->fd.events),
+		.data.ptr = source
+	};
+	if ( -1 == epoll_ctl(loop->epoll_fd, op, source->fd.fd, &event) )
+	{
+		log_message(0, "ERROR: epoll_ctl: %s\n", strerror(errno));
+		return false;
+	}
+	source->registered_events = source->fd.events;
+	return true;
+}
+
+static bool event_loop_init_source (struct Lava_event_loop *loop, struct Lava_event_source *source)
+{
+	source->fd.fd      = -1;
+	source->fd.events  = 0;
+	source->fd.revents = 0;
+	if (! source->init(&source->fd))
+		return false;
+	source->initialized = true;
+	return event_loop_register_source(loop, source, EPOLL_CTL_ADD);
+}
+
+static bool event_loop_finish_source (struct Lava_event_loop *loop, struct Lava_event_source *source)
+{
+	if (! source->initialized)
+		return true;
+	source->initialized = false;
+
+	/* The fd must still be open to be removed from the epoll set. */
+	if ( source->fd.fd != -1 )
+		epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, source->fd.fd, NULL);
+	return source->finish(&source->fd);
 }
 
-void event_loop_add_event_source (struct Lava_event_loop *loop, struct Lava_event_source *source)
+/* Sources can be added before the loop is run or at any time while it runs. */
+bool event_loop_add_event_source (struct Lava_event_loop *loop, struct Lava_event_source *source)
 {
-	source->index = loop->fd_count;
-	loop->fd_count++;
+	source->initialized = false;
 	wl_list_insert(&loop->sources, &source->link);
+
+	if ( loop->running && ! event_loop_init_source(loop, source) )
+	{
+		event_loop_remove_event_source(loop, source);
+		return false;
+	}
+	return true;
+}
+
+/* Sources may also be removed from within their own handlers. */
+void event_loop_remove_event_source (struct Lava_event_loop *loop, struct Lava_event_source *source)
+{
+	for (int i = 0; i < loop->ready_amount; i++)
+		if ( loop->ready[i].data.ptr == source )
+			loop->ready[i].data.ptr = NULL;
+
+	event_loop_finish_source(loop, source);
+	wl_list_remove(&source->link);
+	wl_list_init(&source->link);
+}
+
+static bool event_loop_dispatch (struct Lava_event_loop *loop, int i)
+{
+	struct Lava_event_source *source = loop->ready[i].data.ptr;
+	const uint32_t events = loop->ready[i].events;
+
+	/* Errors and hang-ups are reported to the input handler, which will
+	 * notice them when trying to read.
+	 */
+	short revents = 0;
+	if ( events & (EPOLLIN | EPOLLERR | EPOLLHUP) )
+		revents |= POLLIN;
+	if ( events & EPOLLOUT )
+		revents |= POLLOUT;
+	source->fd.revents = revents;
+
+	if ( revents & POLLIN )
+		if (! source->handle_in(&source->fd))
+			return false;
+
+	/* The source may have been removed (and freed) by its input handler,
+	 * so it must not be touched before checking.
+	 */
+	if ( (revents & POLLOUT) && loop->ready[i].data.ptr != NULL )
+		if (! source->handle_out(&source->fd))
+			return false;
+
+	return true;
 }
 
 bool event_loop_run (struct  Lava_event_loop *loop)
 {
 	log_message(1, "[loop] Starting main loop.\n");
 
-	struct pollfd *fds = calloc(loop->fd_count, sizeof(struct pollfd));
-	if ( fds == NULL )
-	{
-		log_message(0, "ERROR: Can not allocate.\n");
-		return NULL;
-	}
+	struct epoll_event events[32];
 	bool ret = true;
 
 	/* Call init functions */
-	struct Lava_event_source *source;
+	struct Lava_event_source *source, *temp;
 	wl_list_for_each(source, &loop->sources, link)
-		if (! (source->init(&fds[source->index])))
+		if (! event_loop_init_source(loop, source))
 		{
 			ret = false;
 			goto exit;
 		}
+	loop->running = true;
 
 	while (context.loop)
 	{
-		errno = 0;
-
-		/* Call flush functions */
-		wl_list_for_each(source, &loop->sources, link)
-			if (! (source->flush(&fds[source->index])))
+		/* Call flush functions and pick up changes of the events the
+		 * sources are interested in.
+		 */
+		wl_list_for_each_safe(source, temp, &loop->sources, link)
+		{
+			if (! (source->flush(&source->fd)))
 			{
 				ret = false;
 				goto exit;
 			}
+			if ( source->fd.events != source->registered_events
+					&& ! event_loop_register_source(loop, source, EPOLL_CTL_MOD) )
+			{
+				ret = false;
+				goto exit;
+			}
+		}
 
-		if ( poll(fds, loop->fd_count, -1) < 0 )
+		/* Flush functions may dispatch events which stop the loop. */
+		if (! context.loop)
+			break;
+
+		errno = 0;
+		int amount = epoll_wait(loop->epoll_fd, events, 32, -1);
+		if ( amount < 0 )
 		{
 			if ( errno == EINTR )
 				continue;
 
-			log_message(0, "poll: %s\n", strerror(errno));
+			log_message(0, "epoll_wait: %s\n", strerror(errno));
 			ret = false;
 			goto exit;
 		}
 
-		/* Check for events and call handlers */
-		wl_list_for_each(source, &loop->sources, link)
+		/* Only call handlers of sources with events. */
+		loop->ready        = events;
+		loop->ready_amount = amount;
+		for (int i = 0; i < amount; i++)
 		{
-			if ( fds[source->index].revents & POLLIN )
-			{
-				if (! (source->handle_in(&fds[source->index])))
-				{
-					ret = false;
-					goto exit;
-				}
-			}
-
-			if ( fds[source->index].revents & POLLOUT )
+			if ( events[i].data.ptr == NULL )
+				continue;
+			if (! event_loop_dispatch(loop, i))
 			{
-				if (! (source->handle_out(&fds[source->index])))
-				{
-					ret = false;
-					goto exit;
-				}
+				ret = false;
+				break;
 			}
 		}
+		loop->ready        = NULL;
+		loop->ready_amount = 0;
+
+		if (! ret)
+			goto exit;
 	}
 
 exit:
+	loop->running = false;
+
 	/* Call finish functions */
-	wl_list_for_each(source, &loop->sources, link)
-		if (! (source->finish(&fds[source->index])))
-				ret = false;
+	wl_list_for_each_safe(source, temp, &loop->sources, link)
+		if (! event_loop_finish_source(loop, source))
+			ret = false;
 
-	free(fds);
+	close(loop->epoll_fd);
+	loop->epoll_fd = -1;
 	return ret;
 }
-
@@ -23,12 +23,22 @@
 #include<stdbool.h>
 #include<stdint.h>
 #include<poll.h>
+#include<sys/epoll.h>
 #include<wayland-client.h>
 
+struct Lava_event_source;
+
 struct Lava_event_loop
 {
-	nfds_t fd_count;
+	int epoll_fd;
+	bool running;
 	struct wl_list sources;
+
+	/* Events of the current wakeup. Sources removed while they are being
+	 * dispatched are cleared from here.
+	 */
+	struct epoll_event *ready;
+	int ready_amount;
 };
 
 // TODO maybe use wl_signal and wl_listener instead?
@@ -40,11 +50,19 @@ struct Lava_event_source
 	bool (*flush)(struct pollfd *);
 	bool (*handle_in)(struct pollfd *);
 	bool (*handle_out)(struct pollfd *);
-	nfds_t index;
+
+	/* Sources may change the events they are interested in at any time;
+	 * The loop compares them with those it registered the fd with.
+	 */
+	struct pollfd fd;
+	short registered_events;
+	bool  initialized;
 };
 
-void event_loop_init (struct Lava_event_loop *loop);
-void event_loop_add_event_source (struct Lava_event_loop *loop, struct Lava_event_source *source);
+uint64_t event_loop_now (void);
+bool event_loop_init (struct Lava_event_loop *loop);
+bool event_loop_add_event_source (struct Lava_event_loop *loop, struct Lava_event_source *source);
+void event_loop_remove_event_source (struct Lava_event_loop *loop, struct Lava_event_source *source);
 bool event_loop_run (struct  Lava_event_loop *loop);
 
 #endif
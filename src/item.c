@@ -17,24 +17,32 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-#define _POSIX_C_SOURCE 200809L
+/* For POSIX_SPAWN_SETSID. */
+#define _GNU_SOURCE
 
 #include<stdarg.h>
 #include<stdio.h>
 #include<stdlib.h>
 #include<stdbool.h>
+#include<stdint.h>
 #include<unistd.h>
 #include<string.h>
 #include<errno.h>
 #include<sys/wait.h>
+#include<sys/stat.h>
+#include<signal.h>
+#include<spawn.h>
 #include<linux/input-event-codes.h>
 
 #include"lavalauncher.h"
+#include"config.h"
 #include"item.h"
 #include"seat.h"
 #include"str.h"
 #include"bar.h"
 #include"output.h"
+#include"event-loop.h"
+#include"misc-event-sources.h"
 #include"types/image_t.h"
 
 /*******************
@@ -42,8 +50,118 @@
  *  Item commands  *
  *                 *
  *******************/
+#ifdef POSIX_SPAWN_SETSID
+extern char **environ;
+
+/* Copy the environment of LavaLauncher and add the variables describing the
+ * output the command has been triggered on.
+ */
+static char **item_command_environment (struct Lava_bar_instance *instance)
+{
+	size_t amount = 0;
+	while ( environ[amount] != NULL )
+		amount++;
+
+	char **envp = calloc(amount + 3, sizeof(char *));
+	if ( envp == NULL )
+	{
+		log_message(0, "ERROR: Can not allocate.\n");
+		return NULL;
+	}
+
+	size_t i = 0;
+	for (size_t k = 0; k < amount; k++)
+		if ( ! string_starts_with(environ[k], "LAVALAUNCHER_OUTPUT_NAME=")
+				&& ! string_starts_with(environ[k], "LAVALAUNCHER_OUTPUT_SCALE=") )
+			envp[i++] = environ[k];
+
+	/* Only these two entries are owned by the array. */
+	envp[i++] = get_formatted_buffer("LAVALAUNCHER_OUTPUT_NAME=%s",
+			str_orelse(instance->output->name, ""));
+	envp[i++] = get_formatted_buffer("LAVALAUNCHER_OUTPUT_SCALE=%d",
+			instance->output->scale);
+	envp[i] = NULL;
+
+	if ( envp[i-1] == NULL || envp[i-2] == NULL )
+	{
+		free_if_set(envp[i-1]);
+		free_if_set(envp[i-2]);
+		free(envp);
+		return NULL;
+	}
+
+	return envp;
+}
+
+/* Spawn the command in a new session without forking LavaLauncher. The child
+ * is reaped once it exits, see the child tracking in misc-event-sources.c.
+ */
+static void item_command_spawn (struct Lava_item *item, struct Lava_bar_instance *instance,
+		struct Lava_item_command *cmd)
+{
+	char **envp = item_command_environment(instance);
+	if ( envp == NULL )
+		return;
+
+	posix_spawnattr_t attr;
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSID
+			| POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+	/* Restore signals. */
+	sigset_t mask;
+	sigemptyset(&mask);
+	posix_spawnattr_setsigmask(&attr, &mask);
+
+	/* SIGCHLD may be ignored by LavaLauncher, which would be inherited. */
+	sigset_t defaults;
+	sigemptyset(&defaults);
+	sigaddset(&defaults, SIGCHLD);
+	posix_spawnattr_setsigdefault(&attr, &defaults);
+
+	char *shell_argv[] = { "/bin/sh", "-c", cmd->command, NULL };
+	const char *binary = cmd->binary != NULL ? cmd->binary : "/bin/sh";
+	char      **argv   = cmd->argv   != NULL ? cmd->argv   : shell_argv;
+
+	/* posix_spawn() only returns once the child has called exec, so the
+	 * time it takes is the time-to-exec of the command.
+	 */
+	pid_t pid;
+	const uint64_t spawn_time = event_loop_now();
+	int ret = posix_spawn(&pid, binary, NULL, &attr, argv, envp);
+	if ( ret != 0 )
+	{
+		/* Counts like a child which failed right away. */
+		log_message(0, "ERROR: posix_spawn: %s\n", strerror(ret));
+		item->failures++;
+	}
+	else
+	{
+		const uint64_t exec_time = event_loop_now() - spawn_time;
+		item->launches++;
+		item->exec_time_total += exec_time;
+		if ( exec_time > item->exec_time_max )
+			item->exec_time_max = exec_time;
+		log_message(2, "[item] Spawned child: pid=%d item=%u time-to-exec=%.3fms\n",
+				pid, item->index, (double)exec_time / 1000000.0);
+#if HANDLE_SIGNALS
+		track_child(item, pid, spawn_time);
+#endif
+	}
+
+	posix_spawnattr_destroy(&attr);
+
+	/* Free the two entries owned by the array. */
+	size_t i = 0;
+	while ( envp[i] != NULL )
+		i++;
+	free(envp[i-1]);
+	free(envp[i-2]);
+	free(envp);
+}
+#else
 /* We need to fork two times for UNIXy resons. */
-static void item_command_exec_second_fork (struct Lava_bar_instance *instance, const char *cmd)
+static void item_command_exec_second_fork (struct Lava_bar_instance *instance, struct Lava_item_command *cmd)
 {
 	errno = 0;
 	int ret = fork();
@@ -53,9 +171,12 @@ static void item_command_exec_second_fork (struct Lava_bar_instance *instance, c
 		setenvf("LAVALAUNCHER_OUTPUT_NAME",  "%s", instance->output->name);
 		setenvf("LAVALAUNCHER_OUTPUT_SCALE", "%d", instance->output->scale);
 
-		/* execl() only returns on error; On success it replaces this process. */
-		execl("/bin/sh", "/bin/sh", "-c", cmd, NULL);
-		log_message(0, "ERROR: execl: %s\n", strerror(errno));
+		/* exec*() only returns on error; On success it replaces this process. */
+		if ( cmd->binary != NULL )
+			execv(cmd->binary, cmd->argv);
+		else
+			execl("/bin/sh", "/bin/sh", "-c", cmd->command, NULL);
+		log_message(0, "ERROR: exec: %s\n", strerror(errno));
 		_exit(EXIT_FAILURE);
 	}
 	else if ( ret < 0 ) /* Yes, fork can fail. */
@@ -66,7 +187,7 @@ static void item_command_exec_second_fork (struct Lava_bar_instance *instance, c
 }
 
 /* We need to fork two times for UNIXy resons. */
-static void item_command_exec_first_fork (struct Lava_bar_instance *instance, const char *cmd)
+static void item_command_exec_first_fork (struct Lava_bar_instance *instance, struct Lava_item_command *cmd)
 {
 	errno = 0;
 	int ret = fork();
@@ -78,6 +199,7 @@ static void item_command_exec_first_fork (struct Lava_bar_instance *instance, co
 		sigset_t mask;
 		sigemptyset(&mask);
 		sigprocmask(SIG_SETMASK, &mask, NULL);
+		signal(SIGCHLD, SIG_DFL);
 
 		item_command_exec_second_fork(instance, cmd);
 		_exit(EXIT_SUCCESS);
@@ -87,8 +209,10 @@ static void item_command_exec_first_fork (struct Lava_bar_instance *instance, co
 	else
 		waitpid(ret, NULL, 0);
 }
+#endif
 
-static void execute_item_command (struct Lava_item_command *cmd, struct Lava_bar_instance *instance)
+static void execute_item_command (struct Lava_item *item, struct Lava_item_command *cmd,
+		struct Lava_bar_instance *instance)
 {
 	const char *command = cmd->command;
 
@@ -112,7 +236,11 @@ static void execute_item_command (struct Lava_item_command *cmd, struct Lava_bar
 		return;
 	}
 
-	item_command_exec_first_fork(instance, command);
+#ifdef POSIX_SPAWN_SETSID
+	item_command_spawn(item, instance, cmd);
+#else
+	item_command_exec_first_fork(instance, cmd);
+#endif
 }
 
 static struct Lava_item_command *find_item_command (struct Lava_item *item,
@@ -127,7 +255,121 @@ static struct Lava_item_command *find_item_command (struct Lava_item *item,
 	return NULL;
 }
 
-static bool item_add_command (struct Lava_item *item, const char *command,
+static void free_command_argv (char **argv)
+{
+	if ( argv == NULL )
+		return;
+	for (char **arg = argv; *arg != NULL; arg++)
+		free(*arg);
+	free(argv);
+}
+
+/* access() alone also accepts directories, which can not be executed. */
+static bool is_executable_file (const char *path)
+{
+	struct stat stat_buffer;
+	return ! stat(path, &stat_buffer) && S_ISREG(stat_buffer.st_mode)
+		&& ! access(path, X_OK);
+}
+
+/* Search the directories in PATH for an executable file. */
+static char *find_binary_in_path (const char *name)
+{
+	if ( strchr(name, '/') != NULL )
+		return is_executable_file(name) ? strdup(name) : NULL;
+
+	const char *path = getenv("PATH");
+	if ( path == NULL )
+		return NULL;
+
+	while ( *path != '\0' )
+	{
+		size_t length = strcspn(path, ":");
+		char *candidate = get_formatted_buffer("%.*s/%s", (int)length, path, name);
+		if ( candidate == NULL )
+			return NULL;
+
+		if ( length > 0 && is_executable_file(candidate) )
+			return candidate;
+		free(candidate);
+
+		path += length;
+		if ( *path == ':' )
+			path++;
+	}
+
+	return NULL;
+}
+
+/* Split a command into its arguments, unless it uses any shell features, in
+ * which case it has to be run by the shell.
+ */
+static void item_command_tokenize (struct Lava_item_command *cmd)
+{
+	const char *command = cmd->command;
+	if ( command == NULL || strpbrk(command, "|&;<>()$`\\\"'*?[]#~{}!\n") != NULL )
+		return;
+
+	/* Leading variable assignment. */
+	const size_t first_length = strcspn(command + strspn(command, " \t"), " \t");
+	if ( memchr(command + strspn(command, " \t"), '=', first_length) != NULL )
+		return;
+
+	size_t amount = 0;
+	for (const char *c = command; *c != '\0'; )
+	{
+		c += strspn(c, " \t");
+		if ( *c == '\0' )
+			break;
+		amount++;
+		c += strcspn(c, " \t");
+	}
+	if ( amount == 0 )
+		return;
+
+	char **argv = calloc(amount + 1, sizeof(char *));
+	if ( argv == NULL )
+		return;
+
+	size_t i = 0;
+	for (const char *c = command; i < amount; i++)
+	{
+		c += strspn(c, " \t");
+		size_t length = strcspn(c, " \t");
+		if ( NULL == (argv[i] = strndup(c, length)) )
+		{
+			free_command_argv(argv);
+			return;
+		}
+		c += length;
+	}
+
+	/* Shell builtins and unknown commands are left to the shell. */
+	if ( NULL == (cmd->binary = find_binary_in_path(argv[0])) )
+	{
+		free_command_argv(argv);
+		return;
+	}
+
+	cmd->argv = argv;
+	log_message(2, "[item] Command will be executed directly: %s\n", cmd->binary);
+}
+
+/* Set the command string of a command, replacing the arguments and binary
+ * split from the previous one.
+ */
+static void item_command_set (struct Lava_item_command *cmd, const char *command)
+{
+	free_if_set(cmd->binary);
+	free_command_argv(cmd->argv);
+	cmd->binary = NULL;
+	cmd->argv   = NULL;
+
+	set_string(&cmd->command, (char *)command);
+	item_command_tokenize(cmd);
+}
+
+bool item_add_command (struct Lava_item *item, const char *command,
 		enum Interaction_type type, uint32_t modifiers, uint32_t special)
 {
 	TRY_NEW(struct Lava_item_command, cmd, false);
@@ -135,8 +377,11 @@ static bool item_add_command (struct Lava_item *item, const char *command,
 	cmd->type      = type;
 	cmd->modifiers = modifiers;
 	cmd->special   = special;
+	cmd->command   = NULL;
+	cmd->argv      = NULL;
+	cmd->binary    = NULL;
 
-	set_string(&cmd->command, (char *)command);
+	item_command_set(cmd, command);
 
 	wl_list_insert(&item->commands, &cmd->link);
 	return true;
@@ -146,6 +391,8 @@ static void destroy_item_command (struct Lava_item_command *cmd)
 {
 	wl_list_remove(&cmd->link);
 	free_if_set(cmd->command);
+	free_if_set(cmd->binary);
+	free_command_argv(cmd->argv);
 	free(cmd);
 }
 
@@ -305,7 +552,7 @@ static bool button_item_command_from_string (struct Lava_item *button,
 					type, modifiers, special, false);
 			if ( cmd == NULL )
 				return item_add_command(button, command, type, modifiers, special);
-			set_string(&cmd->command, (char *)command);
+			item_command_set(cmd, command);
 			return true;
 		}
 		else if ( *ch == '[' )
@@ -360,18 +607,43 @@ static bool button_item_universal_command (struct Lava_item *button, const char
 			INTERACTION_UNIVERSAL, 0, 0, false);
 	if ( cmd != NULL )
 	{
-		set_string(&cmd->command, (char *)command);
+		item_command_set(cmd, command);
 		return true;
 	}
 
 	return item_add_command(button, command, INTERACTION_UNIVERSAL, 0, 0);
 }
 
+static bool button_set_debounce (struct Lava_item *button, const char *debounce)
+{
+	int ms = atoi(debounce);
+	if ( ms < 0 )
+	{
+		log_message(0, "ERROR: Debounce time must be equal to or greater than 0.\n");
+		return false;
+	}
+	button->debounce = (uint32_t)ms;
+	return true;
+}
+
+static bool button_set_single_instance (struct Lava_item *button, const char *single_instance)
+{
+#if ! HANDLE_SIGNALS
+	log_message(0, "WARNING: LavaLauncher has been compiled without the ability to "
+			"track child processes; \"single-instance\" will have no effect.\n");
+#endif
+	return set_boolean(&button->single_instance, single_instance);
+}
+
 static bool button_set_variable (struct Lava_item *button, const char *variable,
 		const char *value, int line)
 {
 	if (! strcmp("image-path", variable))
 		TRY(button_set_image_path(button, value))
+	else if (! strcmp("debounce", variable))
+		TRY(button_set_debounce(button, value))
+	else if (! strcmp("single-instance", variable))
+		TRY(button_set_single_instance(button, value))
 	else if (! strcmp("command", variable)) /* Generic/universal command */
 		TRY(button_item_universal_command(button, value))
 	else if (string_starts_with(variable, "command"))  /* Command with special bind */
@@ -445,8 +717,25 @@ void item_interaction (struct Lava_item *item, struct Lava_bar_instance *instanc
 			type, modifiers, special);
 
 	struct Lava_item_command *cmd;
-	if ( NULL != (cmd = find_item_command(item, type, modifiers, special, true)) )
-		execute_item_command(cmd, instance);
+	if ( NULL == (cmd = find_item_command(item, type, modifiers, special, true)) )
+		return;
+
+	/* Throttle launches, for example when a button is tapped repeatedly. */
+	const uint64_t now = event_loop_now();
+	if ( item->single_instance && item->running > 0 )
+	{
+		log_message(1, "[item] Not executing command: Still running.\n");
+		return;
+	}
+	if ( item->debounce > 0 && item->last_launch != 0
+			&& now - item->last_launch < (uint64_t)item->debounce * 1000000 )
+	{
+		log_message(1, "[item] Not executing command: Debounced.\n");
+		return;
+	}
+	item->last_launch = now;
+
+	execute_item_command(item, cmd, instance);
 }
 
 bool create_item (struct Lava_bar *bar, enum Item_type type)
@@ -460,6 +749,12 @@ bool create_item (struct Lava_bar *bar, enum Item_type type)
 	item->length   = 0;
 	item->img      = NULL;
 	item->type     = type;
+
+	item->debounce        = 0;
+	item->single_instance = false;
+	item->last_launch     = 0;
+	item->running         = 0;
+
 	bar->last_item = item;
 	wl_list_init(&item->commands);
 	wl_list_insert(&bar->items, &item->link);
@@ -479,23 +774,133 @@ struct Lava_item *item_from_coords (struct Lava_bar_instance *instance, uint32_t
 	else
 		ordinate = y - instance->item_area_dim.y;
 
-	struct Lava_item *item, *temp;
-	wl_list_for_each_reverse_safe(item, temp, &bar->items, link)
+	if ( ordinate >= bar->item_length_sum )
+		return NULL;
+	return bar->item_array[bar->item_at_ordinate[ordinate]];
+}
+
+static bool item_commands_equal (struct Lava_item *a, struct Lava_item *b)
+{
+	if ( wl_list_length(&a->commands) != wl_list_length(&b->commands) )
+		return false;
+
+	struct Lava_item_command *cmd_a, *cmd_b;
+	cmd_b = wl_container_of(b->commands.next, cmd_b, link);
+	wl_list_for_each(cmd_a, &a->commands, link)
 	{
-		if ( ordinate >= item->ordinate
-				&& ordinate < item->ordinate + item->length )
-			return item;
+		if ( cmd_a->type != cmd_b->type || cmd_a->modifiers != cmd_b->modifiers
+				|| cmd_a->special != cmd_b->special
+				|| ! string_equal(cmd_a->command, cmd_b->command) )
+			return false;
+		cmd_b = wl_container_of(cmd_b->link.next, cmd_b, link);
+	}
+	return true;
+}
+
+static bool item_equal (struct Lava_item *a, struct Lava_item *b)
+{
+	/* Images are cached, so identical unchanged files share the same image. */
+	if ( a->type != b->type || a->length != b->length || a->img != b->img
+			|| a->debounce != b->debounce || a->single_instance != b->single_instance )
+		return false;
+
+	return item_commands_equal(a, b);
+}
+
+/* Check whether the items of two bars are identical, which is used to find out
+ * what has changed when the configuration is reloaded.
+ */
+bool items_equal (struct Lava_bar *a, struct Lava_bar *b)
+{
+	if ( a->item_amount != b->item_amount )
+		return false;
+
+	struct Lava_item *item_a, *item_b;
+	item_b = wl_container_of(b->items.next, item_b, link);
+	wl_list_for_each(item_a, &a->items, link)
+	{
+		if (! item_equal(item_a, item_b))
+			return false;
+		item_b = wl_container_of(item_b->link.next, item_b, link);
+	}
+	return true;
+}
+
+/* Hand the launch throttling state of the items of a replaced bar over to the
+ * items of the bar replacing it, so reloading the configuration does not allow
+ * a command to be launched again right away. Items are matched by their
+ * commands, in order.
+ */
+void items_carry_launch_state (struct Lava_bar *from, struct Lava_bar *to)
+{
+	struct Lava_item *item_to, *item_from;
+	wl_list_for_each_reverse(item_to, &to->items, link)
+	{
+		if ( item_to->type != TYPE_BUTTON )
+			continue;
+
+		wl_list_for_each_reverse(item_from, &from->items, link)
+		{
+			if ( item_from->type != TYPE_BUTTON
+					|| ( item_from->last_launch == 0 && item_from->running == 0 )
+					|| ! item_commands_equal(item_from, item_to) )
+				continue;
+
+			item_to->last_launch   = item_from->last_launch;
+			item_from->last_launch = 0;
+
+			/* Children report to the item they are moved to, which
+			 * must therefore also continue its launch statistics.
+			 */
+			item_to->launches        = item_from->launches;
+			item_to->failures        = item_from->failures;
+			item_to->exec_time_total = item_from->exec_time_total;
+			item_to->exec_time_max   = item_from->exec_time_max;
+			item_to->last_status     = item_from->last_status;
+#if HANDLE_SIGNALS
+			children_move_item(item_from, item_to);
+#endif
+			break;
+		}
 	}
-	return NULL;
 }
 
 unsigned int get_item_length_sum (struct Lava_bar *bar)
 {
-	unsigned int sum = 0;
-	struct Lava_item *it1, *it2;
-	wl_list_for_each_reverse_safe (it1, it2, &bar->items, link)
-		sum += it1->length;
-	return sum;
+	return bar->item_length_sum;
+}
+
+static bool build_item_lookup_table (struct Lava_bar *bar)
+{
+	free_if_set(bar->item_array);
+	free_if_set(bar->item_at_ordinate);
+	bar->item_array       = NULL;
+	bar->item_at_ordinate = NULL;
+
+	if ( bar->item_amount > UINT16_MAX )
+	{
+		log_message(0, "ERROR: Too many items.\n");
+		return false;
+	}
+
+	bar->item_array = calloc((size_t)bar->item_amount, sizeof(struct Lava_item *));
+	if ( bar->item_length_sum > 0 )
+		bar->item_at_ordinate = calloc(bar->item_length_sum, sizeof(uint16_t));
+	if ( bar->item_array == NULL || ( bar->item_length_sum > 0 && bar->item_at_ordinate == NULL ) )
+	{
+		log_message(0, "ERROR: Can not allocate.\n");
+		return false;
+	}
+
+	struct Lava_item *item;
+	wl_list_for_each(item, &bar->items, link)
+	{
+		bar->item_array[item->index] = item;
+		for (unsigned int i = item->ordinate; i < item->ordinate + item->length; i++)
+			bar->item_at_ordinate[i] = (uint16_t)item->index;
+	}
+
+	return true;
 }
 
 /* When items are created when parsing the config file, the size is not yet
@@ -512,6 +917,7 @@ bool finalize_items (struct Lava_bar *bar)
 
 
 	unsigned int index = 0, ordinate = 0;
+	bar->atlas_slots = 0;
 	struct Lava_item *it1, *it2;
 	wl_list_for_each_reverse_safe(it1, it2, &bar->items, link)
 	{
@@ -524,14 +930,37 @@ bool finalize_items (struct Lava_bar *bar)
 
 		index++;
 		ordinate += it1->length;
+
+		if ( it1->img == NULL )
+			continue;
+
+		/* Reuse the atlas slot of an earlier item with the same image. */
+		it1->atlas_slot = bar->atlas_slots;
+		struct Lava_item *other;
+		wl_list_for_each_reverse(other, &bar->items, link)
+		{
+			if ( other == it1 )
+				break;
+			if ( other->img == it1->img )
+			{
+				it1->atlas_slot = other->atlas_slot;
+				break;
+			}
+		}
+		if ( it1->atlas_slot == bar->atlas_slots )
+			bar->atlas_slots++;
 	}
 
-	return true;
+	bar->item_length_sum = ordinate;
+	return build_item_lookup_table(bar);
 }
 
 static void destroy_item (struct Lava_item *item)
 {
 	wl_list_remove(&item->link);
+#if HANDLE_SIGNALS
+	children_forget_item(item);
+#endif
 	destroy_all_item_commands(item);
 	DESTROY(item->img, image_t_destroy);
 	free(item);
@@ -543,5 +972,11 @@ void destroy_all_items (struct Lava_bar *bar)
 	struct Lava_item *item, *temp;
 	wl_list_for_each_safe(item, temp, &bar->items, link)
 		destroy_item(item);
+
+	free_if_set(bar->item_array);
+	free_if_set(bar->item_at_ordinate);
+	bar->item_array       = NULL;
+	bar->item_at_ordinate = NULL;
+	bar->item_length_sum  = 0;
 }
 
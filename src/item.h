@@ -51,6 +51,13 @@ struct Lava_item_command
 	char *command;
 	uint32_t modifiers;
 
+	/* Commands not using any shell features are split into arguments when
+	 * the configuration is parsed and executed directly. For all others
+	 * these are NULL and the command is run by /bin/sh.
+	 */
+	char **argv;
+	char  *binary;
+
 	/* For button events this is the button, for scroll events the direction. */
 	uint32_t special;
 };
@@ -64,16 +71,41 @@ struct Lava_item
 	struct wl_list commands;
 
 	unsigned int index, ordinate, length;
+
+	/* Cell of the image in the icon atlases of the bar instances. Buttons
+	 * sharing an image share a cell.
+	 */
+	unsigned int atlas_slot;
+
+	/* Launch statistics of the commands of this item. Times are in
+	 * nanoseconds, last_status is as returned by waitpid().
+	 */
+	unsigned int launches, failures;
+	uint64_t     exec_time_total, exec_time_max;
+	int          last_status;
+
+	/* Launch throttling. Commands are not executed within debounce
+	 * milliseconds of the last launch, or, if single_instance is set, while
+	 * a child spawned by this item is still running.
+	 */
+	uint32_t     debounce;
+	bool         single_instance;
+	uint64_t     last_launch;
+	unsigned int running;
 };
 
 bool create_item (struct Lava_bar *bar, enum Item_type type);
 bool item_set_variable (struct Lava_item *item, const char *variable,
 		const char *value, int line);
+bool item_add_command (struct Lava_item *item, const char *command,
+		enum Interaction_type type, uint32_t modifiers, uint32_t special);
 void item_interaction (struct Lava_item *item, struct Lava_bar_instance *instance,
 		enum Interaction_type type, uint32_t modifiers, uint32_t special);
 struct Lava_item *item_from_coords (struct Lava_bar_instance *instance, uint32_t x, uint32_t y);
 unsigned int get_item_length_sum (struct Lava_bar *bar);
 bool finalize_items (struct Lava_bar *bar);
+bool items_equal (struct Lava_bar *a, struct Lava_bar *b);
+void items_carry_launch_state (struct Lava_bar *from, struct Lava_bar *to);
 void destroy_all_items (struct Lava_bar *bar);
 
 #endif
@@ -25,6 +25,7 @@
 #include<stdbool.h>
 #include<string.h>
 #include<getopt.h>
+#include<signal.h>
 
 #include"bar.h"
 #include"config.h"
@@ -33,6 +34,8 @@
 #include"str.h"
 #include"wayland-connection.h"
 #include"misc-event-sources.h"
+#include"snapshot.h"
+#include"types/image_t.h"
 
 /* The context is used basically everywhere. So instead of passing pointers
  * around, just have it global.
@@ -44,6 +47,7 @@ static bool handle_command_flags (int argc, char *argv[])
 	const char usage[] =
 		"Usage: lavalauncher [options...]\n"
 		"  -c <path>, --config <path> Path to config file.\n"
+		"  -C,        --compile       Write a snapshot of the config file and exit.\n"
 		"  -h,        --help          Print this help text.\n"
 		"  -v,        --verbose       Enable verbose output.\n"
 		"  -V,        --version       Show version.\n"
@@ -52,6 +56,7 @@ static bool handle_command_flags (int argc, char *argv[])
 
 	static struct option opts[] = {
 		{"config",  required_argument, NULL, 'c'},
+		{"compile", no_argument,       NULL, 'C'},
 		{"help",    no_argument,       NULL, 'h'},
 		{"verbose", no_argument,       NULL, 'v'},
 		{"version", no_argument,       NULL, 'V'},
@@ -61,12 +66,16 @@ static bool handle_command_flags (int argc, char *argv[])
 	extern int optind;
 	optind = 0;
 	extern char *optarg;
-	for (int c; (c = getopt_long(argc, argv, "c:hvV", opts, &optind)) != -1 ;) switch (c)
+	for (int c; (c = getopt_long(argc, argv, "c:ChvV", opts, &optind)) != -1 ;) switch (c)
 	{
 		case 'c':
 			set_string(&context.config_path, optarg);
 			break;
 
+		case 'C':
+			context.compile = true;
+			break;
+
 		case 'h':
 			fputs(usage, stderr);
 			context.ret = EXIT_SUCCESS;
@@ -125,11 +134,18 @@ static void init_context (void)
 	context.reload      = false;
 	context.verbosity   = 0;
 	context.config_path = NULL;
+	context.compile     = false;
+
+	context.swapchain_depth = SWAPCHAIN_DEFAULT_DEPTH;
 
 #if WATCH_CONFIG
 	context.watch = false;
 #endif
 
+#if SVG_SUPPORT
+	context.svg_cache = false;
+#endif
+
 	context.display            = NULL;
 	context.registry           = NULL;
 
@@ -170,24 +186,47 @@ reload:
 		if (! get_default_config_path())
 			return EXIT_FAILURE;
 
-	/* Try to parse the configuration file. If this fails, there might
-	 * already be heap objects, so some cleanup is needed.
+	/* Try to load the snapshot of the configuration file or to parse it.
+	 * If this fails, there might already be heap objects, so some cleanup
+	 * is needed.
 	 */
-	if (! parse_config_file())
+	if ( context.compile || ! load_config_snapshot() )
+		if (! parse_config_file())
+			goto exit;
+
+	if (context.compile)
+	{
+		if (write_config_snapshot())
+			context.ret = EXIT_SUCCESS;
 		goto exit;
+	}
+
+	/* Images only used by the configuration before a reload can go now. */
+	image_t_cache_sweep();
 
 	context.ret = EXIT_SUCCESS;
 
 	/* Set up the event loop and attach all event sources. */
 	struct Lava_event_loop loop;
-	event_loop_init(&loop);
+	if (! event_loop_init(&loop))
+	{
+		context.ret = EXIT_FAILURE;
+		goto exit;
+	}
 	event_loop_add_event_source(&loop, &wayland_source);
+	event_loop_add_event_source(&loop, &timer_source);
 #if WATCH_CONFIG
 	if (context.watch)
 		event_loop_add_event_source(&loop, &inotify_source);
 #endif
 #if HANDLE_SIGNALS
 	event_loop_add_event_source(&loop, &signal_source);
+#if HAVE_PIDFD
+	event_loop_add_event_source(&loop, &child_source);
+#endif
+#else
+	/* Let the kernel reap the children spawned for item commands. */
+	signal(SIGCHLD, SIG_IGN);
 #endif
 
 	/* Run the event loop. */
@@ -202,6 +241,8 @@ exit:
 
 	if (context.reload)
 		goto reload;
+
+	image_t_cache_finish();
 	return context.ret;
 }
 
@@ -85,6 +85,9 @@ struct Lava_context
 
 	char *config_path;
 
+	/* Only write a snapshot of the config file instead of running. */
+	bool compile;
+
 	struct wl_list bars;
 	struct Lava_bar *last_bar;
 
@@ -96,9 +99,16 @@ struct Lava_context
 	int  verbosity;
 	int  ret;
 
+	/* Maximum amount of buffers per surface. */
+	int swapchain_depth;
+
 #ifdef WATCH_CONFIG
 	bool watch;
 #endif
+
+#if SVG_SUPPORT
+	bool svg_cache;
+#endif
 };
 
 extern struct Lava_context context;
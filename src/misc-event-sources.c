@@ -17,7 +17,8 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-#define _POSIX_C_SOURCE 200809L
+/* For syscall(). */
+#define _GNU_SOURCE
 
 #include<stdio.h>
 #include<stdlib.h>
@@ -26,6 +27,7 @@
 #include<string.h>
 #include<poll.h>
 #include<errno.h>
+#include<sys/timerfd.h>
 
 #if WATCH_CONFIG
 #include<sys/inotify.h>
@@ -33,11 +35,20 @@
 
 #if HANDLE_SIGNALS
 #include<sys/signalfd.h>
+#include<sys/wait.h>
 #include<signal.h>
 #endif
 
+#if HANDLE_SIGNALS && HAVE_PIDFD
+#include<sys/epoll.h>
+#include<sys/syscall.h>
+#endif
+
 #include"lavalauncher.h"
+#include"config.h"
 #include"event-loop.h"
+#include"misc-event-sources.h"
+#include"item.h"
 #include"str.h"
 
 /**************************
@@ -82,9 +93,24 @@ static bool inotify_source_flush (struct pollfd *fd)
 
 static bool inotify_source_handle_in (struct pollfd *fd)
 {
+	/* Drain the pending events; We only care that something happened. */
+	char buffer[4096];
+	while ( read(fd->fd, buffer, sizeof(buffer)) > 0 );
+
 	log_message(1, "[main] Config file modified; Triggering reload.\n");
-	context.loop = false;
-	context.reload = true;
+	if (! reload_config_file())
+	{
+		context.loop = false;
+		context.reload = true;
+		return true;
+	}
+
+	/* Some editors replace the file instead of modifying it, so the watch
+	 * needs to be renewed.
+	 */
+	if ( -1 == inotify_add_watch(fd->fd, context.config_path, IN_MODIFY) )
+		log_message(0, "WARNING: Unable to re-add config path to inotify watchlist.\n");
+
 	return true;
 }
 
@@ -102,6 +128,391 @@ struct Lava_event_source inotify_source = {
 };
 #endif
 
+/************************
+ *                      *
+ *  Timer event source  *
+ *                      *
+ ************************/
+/* Armed timers, ordered by expiry. A single timerfd is set to the earliest. */
+static struct wl_list timers = { &timers, &timers };
+static int timer_fd = -1;
+
+static void timer_update_timerfd (void)
+{
+	if ( timer_fd == -1 )
+		return;
+
+	/* A zero expiry disarms the timerfd. */
+	struct itimerspec spec = { 0 };
+	if (! wl_list_empty(&timers))
+	{
+		struct Lava_timer *first = wl_container_of(timers.next, first, link);
+		spec.it_value.tv_sec  = (time_t)(first->expiry / 1000000000);
+		spec.it_value.tv_nsec = (long)(first->expiry % 1000000000);
+	}
+
+	if ( -1 == timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, NULL) )
+		log_message(0, "ERROR: timerfd_settime: %s\n", strerror(errno));
+}
+
+static void timer_insert (struct Lava_timer *timer)
+{
+	struct Lava_timer *other;
+	wl_list_for_each(other, &timers, link)
+		if ( other->expiry > timer->expiry )
+			break;
+	wl_list_insert(other->link.prev, &timer->link);
+	timer->armed = true;
+}
+
+void timer_init (struct Lava_timer *timer,
+		void (*callback)(struct Lava_timer *timer, void *data), void *data)
+{
+	wl_list_init(&timer->link);
+	timer->expiry   = 0;
+	timer->interval = 0;
+	timer->armed    = false;
+	timer->callback = callback;
+	timer->data     = data;
+}
+
+/* Arm the timer to expire after delay_ms and, if interval_ms is not 0, every
+ * interval_ms after that. Re-arming an armed timer moves it.
+ */
+void timer_arm (struct Lava_timer *timer, uint32_t delay_ms, uint32_t interval_ms)
+{
+	if (timer->armed)
+		wl_list_remove(&timer->link);
+	timer->expiry   = event_loop_now() + (uint64_t)delay_ms * 1000000;
+	timer->interval = (uint64_t)interval_ms * 1000000;
+	timer_insert(timer);
+	timer_update_timerfd();
+}
+
+void timer_disarm (struct Lava_timer *timer)
+{
+	if (! timer->armed)
+		return;
+	wl_list_remove(&timer->link);
+	wl_list_init(&timer->link);
+	timer->armed = false;
+	timer_update_timerfd();
+}
+
+static bool timer_source_init (struct pollfd *fd)
+{
+	log_message(1, "[loop] Setting up timer event source.\n");
+
+	fd->events = POLLIN;
+	if ( -1 == (fd->fd = timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) )
+	{
+		log_message(0, "ERROR: Unable to open timer fd.\n"
+				"ERROR: timerfd_create: %s\n", strerror(errno));
+		return false;
+	}
+
+	/* Timers may have been armed before the event loop started. */
+	timer_update_timerfd();
+	return true;
+}
+
+static bool timer_source_finish (struct pollfd *fd)
+{
+	if ( fd->fd != -1 )
+		close(fd->fd);
+	timer_fd = -1;
+	return true;
+}
+
+static bool timer_source_flush (struct pollfd *fd)
+{
+	return true;
+}
+
+static bool timer_source_handle_in (struct pollfd *fd)
+{
+	uint64_t expirations;
+	if ( read(fd->fd, &expirations, sizeof(uint64_t)) != sizeof(uint64_t) )
+		return true;
+
+	/* Callbacks may arm and disarm timers, including their own, so the
+	 * list is not iterated over but the first timer taken repeatedly.
+	 */
+	const uint64_t now = event_loop_now();
+	while (! wl_list_empty(&timers))
+	{
+		struct Lava_timer *timer = wl_container_of(timers.next, timer, link);
+		if ( timer->expiry > now )
+			break;
+
+		wl_list_remove(&timer->link);
+		wl_list_init(&timer->link);
+		timer->armed = false;
+
+		/* Periodic timers skip the periods which have been missed. */
+		if ( timer->interval > 0 )
+		{
+			do
+				timer->expiry += timer->interval;
+			while ( timer->expiry <= now );
+			timer_insert(timer);
+		}
+
+		timer->callback(timer, timer->data);
+	}
+
+	timer_update_timerfd();
+	return true;
+}
+
+static bool timer_source_handle_out (struct pollfd *fd)
+{
+	return true;
+}
+
+struct Lava_event_source timer_source = {
+	.init       = timer_source_init,
+	.finish     = timer_source_finish,
+	.flush      = timer_source_flush,
+	.handle_in  = timer_source_handle_in,
+	.handle_out = timer_source_handle_out
+};
+
+/********************
+ *                  *
+ *  Child tracking  *
+ *                  *
+ ********************/
+#if HANDLE_SIGNALS
+/* Children outlive the event loop, so they are kept across reloads. */
+static struct wl_list children = { &children, &children };
+static int child_epoll_fd = -1;
+
+/* Children which could not be tracked, because allocating failed. They are
+ * still reaped when SIGCHLD is received, just without being accounted for.
+ */
+#define UNTRACKED_CHILDREN_MAX 16
+static pid_t untracked_children[UNTRACKED_CHILDREN_MAX];
+static int untracked_children_amount = 0;
+
+static void reap_untracked_children (void)
+{
+	int status;
+	for (int i = 0; i < untracked_children_amount; )
+	{
+		if ( waitpid(untracked_children[i], &status, WNOHANG) != 0 )
+			untracked_children[i] = untracked_children[--untracked_children_amount];
+		else
+			i++;
+	}
+}
+
+void track_child (struct Lava_item *item, pid_t pid, uint64_t spawn_time)
+{
+	struct Lava_child *child = calloc(1, sizeof(struct Lava_child));
+	if ( child == NULL )
+	{
+		log_message(0, "ERROR: Can not allocate.\n");
+
+		/* Without a slot, the child would stay a zombie once it exits. */
+		reap_untracked_children();
+		if ( untracked_children_amount < UNTRACKED_CHILDREN_MAX )
+			untracked_children[untracked_children_amount++] = pid;
+		else
+			log_message(0, "ERROR: Too many untracked children, pid=%d will not be reaped.\n", pid);
+		return;
+	}
+
+	child->item       = item;
+	child->pid        = pid;
+	child->pidfd      = -1;
+	child->spawn_time = spawn_time;
+	wl_list_insert(&children, &child->link);
+	item->running++;
+
+#if HAVE_PIDFD
+	/* The pid can not be reused before we reap it, so opening the pidfd
+	 * after the fact is safe even if the child already exited.
+	 */
+	child->pidfd = (int)syscall(SYS_pidfd_open, pid, 0);
+	if ( child->pidfd == -1 )
+	{
+		/* Likely the kernel is too old, so this would repeat for every
+		 * single child.
+		 */
+		static bool warned = false;
+		if (! warned)
+			log_message(1, "[loop] pidfd_open failed, reaping children on SIGCHLD instead: %s\n",
+					strerror(errno));
+		warned = true;
+		return;
+	}
+
+	if ( child_epoll_fd != -1 )
+	{
+		struct epoll_event event = { .events = EPOLLIN, .data.ptr = child };
+		if ( -1 == epoll_ctl(child_epoll_fd, EPOLL_CTL_ADD, child->pidfd, &event) )
+			log_message(0, "ERROR: epoll_ctl: %s\n", strerror(errno));
+	}
+#endif
+}
+
+/* Children of a replaced item count as children of its replacement. */
+void children_move_item (struct Lava_item *from, struct Lava_item *to)
+{
+	struct Lava_child *child;
+	wl_list_for_each(child, &children, link)
+		if ( child->item == from )
+		{
+			child->item = to;
+			from->running--;
+			to->running++;
+		}
+}
+
+/* Items may be destroyed while their children are still running. */
+void children_forget_item (struct Lava_item *item)
+{
+	struct Lava_child *child;
+	wl_list_for_each(child, &children, link)
+		if ( child->item == item )
+		{
+			child->item = NULL;
+			item->running--;
+		}
+}
+
+static void child_exited (struct Lava_child *child, int status)
+{
+	const double runtime = (double)(event_loop_now() - child->spawn_time) / 1000000000.0;
+	if (WIFSIGNALED(status))
+		log_message(2, "[loop] Child killed: pid=%d signal=%d runtime=%.3fs\n",
+				child->pid, WTERMSIG(status), runtime);
+	else
+		log_message(2, "[loop] Child exited: pid=%d status=%d runtime=%.3fs\n",
+				child->pid, WEXITSTATUS(status), runtime);
+
+	struct Lava_item *item = child->item;
+	if ( item != NULL )
+	{
+		if ( WIFSIGNALED(status) || WEXITSTATUS(status) != 0 )
+			item->failures++;
+		item->last_status = status;
+		item->running--;
+		log_message(2, "[item] Launch statistics: item=%u launches=%u failures=%u "
+				"time-to-exec-avg=%.3fms time-to-exec-max=%.3fms\n",
+				item->index, item->launches, item->failures,
+				(double)item->exec_time_total / (double)item->launches / 1000000.0,
+				(double)item->exec_time_max / 1000000.0);
+	}
+
+#if HAVE_PIDFD
+	if ( child->pidfd != -1 )
+	{
+		if ( child_epoll_fd != -1 )
+			epoll_ctl(child_epoll_fd, EPOLL_CTL_DEL, child->pidfd, NULL);
+		close(child->pidfd);
+	}
+#endif
+	wl_list_remove(&child->link);
+	free(child);
+}
+
+static void reap_children_without_pidfd (void)
+{
+	/* Only reap children we know of, to not steal the exit status of those
+	 * with a pidfd. Multiple SIGCHLD may have been merged into one.
+	 */
+	int status;
+	struct Lava_child *child, *tmp;
+	wl_list_for_each_safe(child, tmp, &children, link)
+		if ( child->pidfd == -1 && waitpid(child->pid, &status, WNOHANG) > 0 )
+			child_exited(child, status);
+
+	reap_untracked_children();
+}
+
+#if HAVE_PIDFD
+static bool child_source_init (struct pollfd *fd)
+{
+	log_message(1, "[loop] Setting up child event source.\n");
+
+	/* An epoll fd is used to wait on the pidfds of all children with a
+	 * single entry in the poll set.
+	 */
+	fd->events = POLLIN;
+	if ( -1 == (fd->fd = child_epoll_fd = epoll_create1(EPOLL_CLOEXEC)) )
+	{
+		log_message(0, "ERROR: Unable to open epoll fd.\n"
+				"ERROR: epoll_create1: %s\n", strerror(errno));
+		return false;
+	}
+
+	/* Children spawned before a reload. */
+	struct Lava_child *child;
+	wl_list_for_each(child, &children, link)
+	{
+		if ( child->pidfd == -1 )
+			continue;
+		struct epoll_event event = { .events = EPOLLIN, .data.ptr = child };
+		if ( -1 == epoll_ctl(child_epoll_fd, EPOLL_CTL_ADD, child->pidfd, &event) )
+			log_message(0, "ERROR: epoll_ctl: %s\n", strerror(errno));
+	}
+
+	return true;
+}
+
+static bool child_source_finish (struct pollfd *fd)
+{
+	if ( fd->fd != -1 )
+		close(fd->fd);
+	child_epoll_fd = -1;
+	return true;
+}
+
+static bool child_source_flush (struct pollfd *fd)
+{
+	return true;
+}
+
+static bool child_source_handle_in (struct pollfd *fd)
+{
+	struct epoll_event events[16];
+	int amount = epoll_wait(fd->fd, events, 16, 0);
+	if ( amount == -1 )
+	{
+		if ( errno == EINTR )
+			return true;
+		log_message(0, "ERROR: epoll_wait: %s\n", strerror(errno));
+		return false;
+	}
+
+	int status;
+	for (int i = 0; i < amount; i++)
+	{
+		struct Lava_child *child = events[i].data.ptr;
+		if ( waitpid(child->pid, &status, WNOHANG) > 0 )
+			child_exited(child, status);
+	}
+
+	return true;
+}
+
+static bool child_source_handle_out (struct pollfd *fd)
+{
+	return true;
+}
+
+struct Lava_event_source child_source = {
+	.init       = child_source_init,
+	.finish     = child_source_finish,
+	.flush      = child_source_flush,
+	.handle_in  = child_source_handle_in,
+	.handle_out = child_source_handle_out
+};
+#endif
+#endif
+
 /*************************
  *                       *
  *  Signal event source  *
@@ -119,6 +530,7 @@ static bool signal_source_init (struct pollfd *fd)
 	sigaddset(&mask, SIGQUIT);
 	sigaddset(&mask, SIGUSR1);
 	sigaddset(&mask, SIGUSR2);
+	sigaddset(&mask, SIGCHLD);
 
 	if ( sigprocmask(SIG_BLOCK, &mask, NULL) == -1 )
 	{
@@ -164,9 +576,21 @@ static bool signal_source_handle_in (struct pollfd *fd)
 		log_message(1, "[loop] Received SIGTERM or SIGQUIT; Exiting.\n");
 		return false;
 	}
-	else if ( fdsi.ssi_signo == SIGUSR1 || fdsi.ssi_signo == SIGUSR2 )
+	else if ( fdsi.ssi_signo == SIGUSR1 )
+	{
+		log_message(1, "[loop] Received SIGUSR1; Triggering reload.\n");
+		if (! reload_config_file())
+		{
+			context.loop = false;
+			context.reload = true;
+			return false;
+		}
+	}
+	else if ( fdsi.ssi_signo == SIGCHLD )
+		reap_children_without_pidfd();
+	else if ( fdsi.ssi_signo == SIGUSR2 )
 	{
-		log_message(1, "[loop] Received SIGUSR; Triggering reload.\n");
+		log_message(1, "[loop] Received SIGUSR2; Triggering full reload.\n");
 		context.loop = false;
 		context.reload = true;
 		return false;
@@ -20,10 +20,58 @@
 #ifndef LAVALAUNCHER_MISC_EVENT_SOURCES_H
 #define LAVALAUNCHER_MISC_EVENT_SOURCES_H
 
-struct Lava_ecent_source;
+#include<stdbool.h>
+#include<stdint.h>
+#include<sys/types.h>
+#include<wayland-client.h>
+
+struct Lava_event_source;
+struct Lava_item;
+
+/* A child process spawned for an item command. */
+struct Lava_child
+{
+	struct wl_list    link;
+	struct Lava_item *item;
+	pid_t             pid;
+
+	/* Children without a pidfd are reaped when SIGCHLD is received. */
+	int pidfd;
+
+	/* Monotonic time in nanoseconds. */
+	uint64_t spawn_time;
+};
+
+/* A one-shot or periodic timer. Timers are embedded in the objects using them
+ * and must be disarmed before those are freed.
+ */
+struct Lava_timer
+{
+	struct wl_list link;
+
+	/* Monotonic time in nanoseconds. Interval is 0 for one-shot timers. */
+	uint64_t expiry, interval;
+	bool     armed;
+
+	void (*callback)(struct Lava_timer *timer, void *data);
+	void  *data;
+};
 
 extern struct Lava_event_source inotify_source;
 extern struct Lava_event_source signal_source;
+extern struct Lava_event_source child_source;
+extern struct Lava_event_source timer_source;
+
+void timer_init (struct Lava_timer *timer,
+		void (*callback)(struct Lava_timer *timer, void *data), void *data);
+void timer_arm (struct Lava_timer *timer, uint32_t delay_ms, uint32_t interval_ms);
+void timer_disarm (struct Lava_timer *timer);
+
+#if HANDLE_SIGNALS
+void track_child (struct Lava_item *item, pid_t pid, uint64_t spawn_time);
+void children_forget_item (struct Lava_item *item);
+void children_move_item (struct Lava_item *from, struct Lava_item *to);
+#endif
 
 #endif
 
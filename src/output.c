@@ -42,6 +42,47 @@
 /* No-Op function. */
 static void noop () {}
 
+/* Create / destroy / update the instance of a single bar on this output. */
+static bool update_bar_on_output (struct Lava_bar *bar, struct Lava_output *output)
+{
+	/* Try to find a configuration set of the bar which fits this output. */
+	struct Lava_bar_configuration *config = get_bar_config_for_output(bar, output);
+
+	/* Try to get the instance of the bar for this output, if it exists. */
+	struct Lava_bar_instance *instance = bar_instance_from_bar(bar, output);
+
+	if ( instance != NULL )
+	{
+		/* If we have an instance, apply the configuration set and update it.
+		 * If we do not have a configuration set, then config == NULL, which
+		 * will cause the destruction of the instance.
+		 */
+		instance->config = config;
+		update_bar_instance(instance, BAR_UPDATE_DIMENSIONS);
+	}
+	else if ( config != NULL )
+	{
+		/* If we have a configuration set, but no instance, we need to create one. */
+		if (! create_bar_instance(bar, config, output))
+		{
+			log_message(0, "ERROR: Could not create bar instance.\n");
+			context.loop = false;
+			context.ret  = EXIT_FAILURE;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void update_output_status (struct Lava_output *output)
+{
+	if (wl_list_empty(&output->bar_instances))
+		output->status = OUTPUT_STATUS_UNUSED;
+	else
+		output->status = OUTPUT_STATUS_USED;
+}
+
 /* Loop through all bar patterns and create / destroy / update their instances on this output. */
 static bool update_bar_instances_on_output (struct Lava_output *output)
 {
@@ -66,40 +107,29 @@ static bool update_bar_instances_on_output (struct Lava_output *output)
 
 	struct Lava_bar *bar, *temp;
 	wl_list_for_each_safe(bar, temp, &context.bars, link)
-	{
-		/* Try to find a configuration set of the bar which fits this output. */
-		struct Lava_bar_configuration *config = get_bar_config_for_output(bar, output);
+		if (! update_bar_on_output(bar, output))
+			return false;
 
-		/* Try to get the instance of the bar for this output, if it exists. */
-		struct Lava_bar_instance *instance = bar_instance_from_bar(bar, output);
+	update_output_status(output);
 
-		if ( instance != NULL )
-		{
-			/* If we have an instance, apply the configuration set and update it.
-			 * If we do not have a configuration set, then config == NULL, which
-			 * will cause the destruction of the instance.
-			 */
-			instance->config = config;
-			update_bar_instance(instance, true, false);
-		}
-		else if ( config != NULL )
-		{
-			/* If we have a configuration set, but no instance, we need to create one. */
-			if (! create_bar_instance(bar, config, output))
-			{
-				log_message(0, "ERROR: Could not create bar instance.\n");
-				context.loop = false;
-				context.ret  = EXIT_FAILURE;
-				return false;
-			}
-		}
-	}
+	return true;
+}
 
-	if (wl_list_empty(&output->bar_instances))
-		output->status = OUTPUT_STATUS_UNUSED;
-	else
-		output->status = OUTPUT_STATUS_USED;
+/* Create / destroy / update the instances of a single bar on all usable outputs. */
+bool update_bar_on_all_outputs (struct Lava_bar *bar)
+{
+	struct Lava_output *output;
+	wl_list_for_each(output, &context.outputs, link)
+	{
+		if ( output->status == OUTPUT_STATUS_UNCONFIGURED || output->name == NULL
+				|| output->w == 0 || output->h == 0 )
+			continue;
+
+		if (! update_bar_on_output(bar, output))
+			return false;
 
+		update_output_status(output);
+	}
 	return true;
 }
 
@@ -182,7 +212,7 @@ static void update_river_output_occupied_state (struct Lava_output *output)
 			output->river_output_occupied ? "true" : "false");
 	struct Lava_bar_instance *instance;
 	wl_list_for_each(instance, &output->bar_instances, link)
-		update_bar_instance(instance, false, true);
+		update_bar_instance(instance, BAR_UPDATE_HIDDEN);
 }
 
 static void river_status_handle_focused_tags (void *data, struct zriver_output_status_v1 *river_status,
@@ -270,6 +300,7 @@ bool create_output (struct wl_registry *registry, uint32_t name,
 	output->river_output_occupied = false;
 
 	wl_list_init(&output->bar_instances);
+	init_shm_pool(&output->shm_pool);
 
 	wl_list_insert(&context.outputs, &output->link);
 	wl_output_set_user_data(wl_output, output);
@@ -308,6 +339,7 @@ void destroy_output (struct Lava_output *output)
 	DESTROY(output->river_status, zriver_output_status_v1_destroy);
 	free_if_set(output->name);
 	destroy_all_bar_instances(output);
+	finish_shm_pool(&output->shm_pool);
 	wl_list_remove(&output->link);
 	wl_output_destroy(output->wl_output);
 	free(output);
@@ -22,6 +22,10 @@
 
 #include<wayland-server.h>
 
+#include"types/buffer.h"
+
+struct Lava_bar;
+
 enum Lava_output_status
 {
 	/* Output has been created, but does not yet have an xdg_output or any bars. */
@@ -55,6 +59,9 @@ struct Lava_output
 	uint32_t w, h;
 
 	enum Lava_output_status status;
+
+	/* All buffers of the bar instances on this output are allocated here. */
+	struct Lava_shm_pool shm_pool;
 };
 
 bool create_output (struct wl_registry *registry, uint32_t name,
@@ -63,6 +70,7 @@ bool configure_output (struct Lava_output *output);
 struct Lava_output *get_output_from_global_name (uint32_t name);
 void destroy_output (struct Lava_output *output);
 void destroy_all_outputs (void);
+bool update_bar_on_all_outputs (struct Lava_bar *bar);
 
 #endif
 
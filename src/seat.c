@@ -27,7 +27,6 @@
 #include<string.h>
 #include<errno.h>
 #include<sys/mman.h>
-#include<assert.h>
 
 #include<wayland-client.h>
 #include<wayland-client-protocol.h>
@@ -188,11 +187,11 @@ static bool create_touchpoint (struct Lava_seat *seat, int32_t id,
 	touchpoint->instance = instance;
 	touchpoint->item     = item;
 
-	touchpoint->indicator = create_indicator(instance);
+	touchpoint->indicator = take_indicator(instance);
 	if ( touchpoint->indicator != NULL )
 	{
 		touchpoint->indicator->touchpoint = touchpoint;
-		indicator_set_colour(touchpoint->indicator, &instance->config->indicator_active_colour);
+		indicator_set_state(touchpoint->indicator, INDICATOR_ACTIVE);
 		move_indicator(touchpoint->indicator, item);
 		indicator_commit(touchpoint->indicator);
 	}
@@ -206,7 +205,7 @@ static bool create_touchpoint (struct Lava_seat *seat, int32_t id,
 
 static void destroy_touchpoint (struct Lava_touchpoint *touchpoint)
 {
-	DESTROY(touchpoint->indicator, destroy_indicator);
+	DESTROY(touchpoint->indicator, release_indicator);
 	wl_list_remove(&touchpoint->link);
 	free(touchpoint);
 }
@@ -218,6 +217,25 @@ static void destroy_all_touchpoints (struct Lava_seat *seat)
 		destroy_touchpoint(tp);
 }
 
+/* Drop all references the seats hold to the items of the bar instance, which
+ * is needed before the items are destroyed or the instance switches to
+ * different ones.
+ */
+void seats_forget_items (struct Lava_bar_instance *instance)
+{
+	struct Lava_seat *seat;
+	wl_list_for_each(seat, &context.seats, link)
+	{
+		if ( seat->pointer.instance == instance )
+			seat->pointer.item = NULL;
+
+		struct Lava_touchpoint *tp, *temp;
+		wl_list_for_each_safe(tp, temp, &seat->touch.touchpoints, link)
+			if ( tp->instance == instance )
+				destroy_touchpoint(tp);
+	}
+}
+
 static struct Lava_touchpoint *touchpoint_from_id (struct Lava_seat *seat, int32_t id)
 {
 	struct Lava_touchpoint *touchpoint;
@@ -336,68 +354,118 @@ static void seat_init_touch (struct Lava_seat *seat)
  *  Cursor  *
  *          *
  ************/
+/* Cursor themes are loaded once per theme, size and scale and kept until the
+ * Wayland connection is closed, as loading one reads and decodes all its
+ * cursor files and allocates a shm pool for them.
+ */
+struct Lava_cursor_theme
+{
+	struct wl_list          link;
+	char                   *name;
+	int32_t                 size;
+	uint32_t                scale;
+	struct wl_cursor_theme *theme;
+};
+
+static struct wl_list cursor_themes = { &cursor_themes, &cursor_themes };
+
+static struct wl_cursor_theme *get_cursor_theme (const char *name, int32_t size, uint32_t scale)
+{
+	struct Lava_cursor_theme *cursor_theme;
+	wl_list_for_each(cursor_theme, &cursor_themes, link)
+		if ( cursor_theme->size == size && cursor_theme->scale == scale
+				&& string_equal(cursor_theme->name, name) )
+			return cursor_theme->theme;
+
+	log_message(2, "[seat] Loading cursor theme: name=%s size=%d scale=%d\n",
+			str_orelse(name, "default"), size, scale);
+
+	TRY_NEW(struct Lava_cursor_theme, new_theme, NULL);
+	new_theme->size  = size;
+	new_theme->scale = scale;
+	new_theme->name  = NULL;
+	if ( name != NULL )
+		set_string(&new_theme->name, (char *)name);
+
+	if ( NULL == (new_theme->theme = wl_cursor_theme_load(name, size * (int32_t)scale, context.shm)) )
+	{
+		log_message(0, "ERROR: Could not load cursor theme.\n");
+		free_if_set(new_theme->name);
+		free(new_theme);
+		return NULL;
+	}
+
+	wl_list_insert(&cursor_themes, &new_theme->link);
+	return new_theme->theme;
+}
+
+void destroy_cursor_themes (void)
+{
+	struct Lava_cursor_theme *cursor_theme, *temp;
+	wl_list_for_each_safe(cursor_theme, temp, &cursor_themes, link)
+	{
+		wl_cursor_theme_destroy(cursor_theme->theme);
+		free_if_set(cursor_theme->name);
+		wl_list_remove(&cursor_theme->link);
+		free(cursor_theme);
+	}
+}
+
 static void seat_pointer_unset_cursor (struct Lava_seat *seat)
 {
-	DESTROY_NULL(seat->pointer.cursor_theme, wl_cursor_theme_destroy);
 	DESTROY_NULL(seat->pointer.cursor_surface, wl_surface_destroy);
 
-	 /* These just points back to the theme. */
-	seat->pointer.cursor       = NULL;
+	 /* This just points into a cached theme. */
 	seat->pointer.cursor_image = NULL;
+	seat->pointer.cursor_scale = 0;
 }
 
 static void seat_pointer_set_cursor (struct Lava_seat *seat, uint32_t serial, const char *name)
 {
 	struct wl_pointer *pointer = seat->pointer.wl_pointer;
 
-	int32_t scale       = (int32_t)seat->pointer.instance->output->scale;
-	int32_t cursor_size = 24; // TODO ?
+	uint32_t scale       = seat->pointer.instance->output->scale;
+	int32_t  cursor_size = 24; // TODO ?
 
-	/* Cleanup any leftover cursor stuff. */
-	seat_pointer_unset_cursor(seat);
-
-	if ( NULL == (seat->pointer.cursor_theme = wl_cursor_theme_load(NULL, cursor_size * scale, context.shm)) )
-	{
-		log_message(0, "ERROR: Could not load cursor theme.\n");
+	struct wl_cursor_theme *theme = get_cursor_theme(NULL, cursor_size, scale);
+	if ( theme == NULL )
 		return;
-	}
 
-	if ( NULL == (seat->pointer.cursor = wl_cursor_theme_get_cursor(
-					seat->pointer.cursor_theme, name)) )
+	struct wl_cursor *cursor = wl_cursor_theme_get_cursor(theme, name);
+	if ( cursor == NULL || cursor->image_count == 0 )
 	{
 		log_message(0, "WARNING: Could not get cursor \"%s\".\n"
 				"         This cursor is likely missing from your cursor theme.\n",
 				name);
-		seat_pointer_unset_cursor(seat);
 		return;
 	}
+	struct wl_cursor_image *image = cursor->images[0];
 
-	seat->pointer.cursor_image = seat->pointer.cursor->images[0];
-	assert(seat->pointer.cursor_image); // TODO Propably not needed; A non-fatal fail would be better here anyway
-
-	if ( NULL == (seat->pointer.cursor_surface = wl_compositor_create_surface(context.compositor)) )
+	/* Every seat has a single cursor surface for its entire lifetime. */
+	if ( seat->pointer.cursor_surface == NULL
+			&& NULL == (seat->pointer.cursor_surface = wl_compositor_create_surface(context.compositor)) )
 	{
 		log_message(0, "ERROR: Could not create cursor surface.\n");
-		seat_pointer_unset_cursor(seat);
 		return;
 	}
 
-	/* The entire dance of getting cursor image and surface and damaging
-	 * the latter is indeed necessary every time a seats pointer enters the
-	 * surface and we want to change its cursor image, because we need to
-	 * apply the scale of the current output to the cursor.
+	/* The surface only needs a new buffer if the cursor image or the scale
+	 * of the output changed since the last time the pointer entered a bar.
 	 */
-
-	wl_surface_set_buffer_scale(seat->pointer.cursor_surface, scale);
-	wl_surface_attach(seat->pointer.cursor_surface,
-			wl_cursor_image_get_buffer(seat->pointer.cursor_image),
-			0, 0);
-	wl_surface_damage_buffer(seat->pointer.cursor_surface, 0, 0, INT32_MAX, INT32_MAX);
-	wl_surface_commit(seat->pointer.cursor_surface);
+	if ( image != seat->pointer.cursor_image || scale != seat->pointer.cursor_scale )
+	{
+		wl_surface_set_buffer_scale(seat->pointer.cursor_surface, (int32_t)scale);
+		wl_surface_attach(seat->pointer.cursor_surface,
+				wl_cursor_image_get_buffer(image), 0, 0);
+		wl_surface_damage_buffer(seat->pointer.cursor_surface, 0, 0, INT32_MAX, INT32_MAX);
+		wl_surface_commit(seat->pointer.cursor_surface);
+		seat->pointer.cursor_image = image;
+		seat->pointer.cursor_scale = scale;
+	}
 
 	wl_pointer_set_cursor(pointer, serial, seat->pointer.cursor_surface,
-			(int32_t)seat->pointer.cursor_image->hotspot_x / scale,
-			(int32_t)seat->pointer.cursor_image->hotspot_y / scale);
+			(int32_t)(image->hotspot_x / scale),
+			(int32_t)(image->hotspot_y / scale));
 }
 
 /*************
@@ -413,7 +481,7 @@ static void pointer_handle_leave (void *data, struct wl_pointer *wl_pointer,
 {
 	struct Lava_seat *seat = (struct Lava_seat *)data;
 
-	DESTROY(seat->pointer.indicator, destroy_indicator);
+	DESTROY(seat->pointer.indicator, release_indicator);
 
 	struct Lava_bar_instance *instance = seat->pointer.instance;
 
@@ -422,7 +490,9 @@ static void pointer_handle_leave (void *data, struct wl_pointer *wl_pointer,
 	seat->pointer.instance = NULL;
 	seat->pointer.item     = NULL;
 
-	bar_instance_pointer_leave(instance);
+	/* The instance may have been destroyed while the pointer was over it. */
+	if ( instance != NULL )
+		bar_instance_pointer_leave(instance);
 
 	log_message(1, "[input] Pointer left surface.\n");
 }
@@ -455,6 +525,9 @@ static void pointer_handle_motion(void *data, struct wl_pointer *wl_pointer,
 	seat->pointer.x = (uint32_t)wl_fixed_to_int(x);
 	seat->pointer.y = (uint32_t)wl_fixed_to_int(y);
 
+	if ( seat->pointer.instance == NULL )
+		return;
+
 	/* It is enough to only update the indicator every other motion event. */
 	static bool skip = false;
 	if (skip)
@@ -470,13 +543,13 @@ static void pointer_handle_motion(void *data, struct wl_pointer *wl_pointer,
 
 	if ( item == NULL || item->type != TYPE_BUTTON )
 	{
-		DESTROY(seat->pointer.indicator, destroy_indicator);
+		DESTROY(seat->pointer.indicator, release_indicator);
 		return;
 	}
 
 	if ( seat->pointer.indicator == NULL )
 	{
-		seat->pointer.indicator = create_indicator(seat->pointer.instance);
+		seat->pointer.indicator = take_indicator(seat->pointer.instance);
 		if ( seat->pointer.indicator == NULL )
 		{
 			log_message(0, "ERROR: Could not create indicator.\n");
@@ -484,8 +557,7 @@ static void pointer_handle_motion(void *data, struct wl_pointer *wl_pointer,
 		}
 		seat->pointer.indicator->seat = seat;
 
-		indicator_set_colour(seat->pointer.indicator,
-				&seat->pointer.instance->config->indicator_hover_colour);
+		indicator_set_state(seat->pointer.indicator, INDICATOR_HOVER);
 	}
 
 	move_indicator(seat->pointer.indicator, item);
@@ -510,8 +582,7 @@ static void pointer_handle_button (void *data, struct wl_pointer *wl_pointer,
 	{
 		if ( seat->pointer.indicator != NULL )
 		{
-			indicator_set_colour(seat->pointer.indicator,
-					&seat->pointer.instance->config->indicator_active_colour);
+			indicator_set_state(seat->pointer.indicator, INDICATOR_ACTIVE);
 			indicator_commit(seat->pointer.indicator);
 		}
 
@@ -524,8 +595,7 @@ static void pointer_handle_button (void *data, struct wl_pointer *wl_pointer,
 	{
 		if ( seat->pointer.indicator != NULL )
 		{
-			indicator_set_colour(seat->pointer.indicator,
-					&seat->pointer.instance->config->indicator_hover_colour);
+			indicator_set_state(seat->pointer.indicator, INDICATOR_HOVER);
 			indicator_commit(seat->pointer.indicator);
 		}
 
@@ -564,12 +634,15 @@ static void pointer_handle_axis (void *data, struct wl_pointer *wl_pointer,
 		return;
 	}
 
-	if ( seat->pointer.discrete_steps == 0
-			&& time - seat->pointer.last_update_time > CONTINUOUS_SCROLL_TIMEOUT )
-		seat->pointer.value = 0;
+	seat->pointer.value += value;
+	timer_arm(&seat->pointer.scroll_idle, CONTINUOUS_SCROLL_TIMEOUT, 0);
+}
 
-	seat->pointer.value            += value;
-	seat->pointer.last_update_time  = time;
+static void pointer_handle_scroll_idle (struct Lava_timer *timer, void *data)
+{
+	struct Lava_seat *seat = data;
+	if ( seat->pointer.discrete_steps == 0 )
+		seat->pointer.value = 0;
 }
 
 static void pointer_handle_axis_discrete (void *data,
@@ -662,6 +735,7 @@ static const struct wl_pointer_listener pointer_listener = {
 static void seat_release_pointer (struct Lava_seat *seat)
 {
 	seat_pointer_unset_cursor(seat);
+	timer_disarm(&seat->pointer.scroll_idle);
 	DESTROY_NULL(seat->pointer.wl_pointer, wl_pointer_release);
 }
 
@@ -680,13 +754,12 @@ static void seat_init_pointer (struct Lava_seat *seat)
 	seat->pointer.instance         = NULL;
 	seat->pointer.item             = NULL;
 	seat->pointer.discrete_steps   = 0;
-	seat->pointer.last_update_time = 0;
 	seat->pointer.value            = wl_fixed_from_int(0);
 	seat->pointer.indicator        = NULL;
 	seat->pointer.cursor_surface   = NULL;
-	seat->pointer.cursor_theme     = NULL;
 	seat->pointer.cursor_image     = NULL;
-	seat->pointer.cursor           = NULL;
+	seat->pointer.cursor_scale     = 0;
+	timer_init(&seat->pointer.scroll_idle, pointer_handle_scroll_idle, seat);
 }
 
 /**********
@@ -26,8 +26,10 @@
 #include<xkbcommon/xkbcommon.h>
 
 #include"types/buffer.h"
+#include"misc-event-sources.h"
 
 struct Lava_bar;
+struct Lava_bar_instance;
 struct Lava_item_indicator;
 
 enum Modifiers
@@ -76,18 +78,23 @@ struct Lava_seat
 		struct Lava_bar_instance *instance;
 		struct Lava_item *item;
 
-		/* Stuff needed to gracefully handle scroll events. */
-		uint32_t   discrete_steps, last_update_time;
-		wl_fixed_t value;
+		/* Stuff needed to gracefully handle scroll events. The
+		 * accumulated value is reset when scrolling has been idle for
+		 * a while.
+		 */
+		uint32_t          discrete_steps;
+		wl_fixed_t        value;
+		struct Lava_timer scroll_idle;
 
 		/* Hover indicator. */
 		struct Lava_item_indicator *indicator;
 
-		/* Stuff needed to change the cursor image. */
+		/* Stuff needed to change the cursor image. The image currently
+		 * attached to the surface belongs to a cached cursor theme.
+		 */
 		struct wl_surface      *cursor_surface;
-		struct wl_cursor_theme *cursor_theme;
 		struct wl_cursor_image *cursor_image;
-		struct wl_cursor       *cursor;
+		uint32_t                cursor_scale;
 	} pointer;
 
 	struct
@@ -100,6 +107,8 @@ struct Lava_seat
 bool create_seat (struct wl_registry *registry, uint32_t name,
 		const char *interface, uint32_t version);
 void destroy_all_seats (void);
+void destroy_cursor_themes (void);
+void seats_forget_items (struct Lava_bar_instance *instance);
 
 #endif
 
@@ -0,0 +1,616 @@
+/*
+ * LavaLauncher - A simple launcher panel for Wayland
+ *
+ * Copyright (C) 2020 - 2021 Leon Henrik Plickat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<stdint.h>
+#include<unistd.h>
+#include<string.h>
+#include<errno.h>
+#include<fcntl.h>
+#include<sys/stat.h>
+#include<sys/mman.h>
+#include<wayland-server.h>
+
+#include"lavalauncher.h"
+#include"snapshot.h"
+#include"str.h"
+#include"bar.h"
+#include"item.h"
+#include"config.h"
+#include"types/image_t.h"
+#include"types/buffer.h"
+
+/* A snapshot is the parsed and validated configuration, stored next to the
+ * config file as "<config>.snapshot". It consists of a header, followed by a
+ * record for every bar, which is followed by the records of its configuration
+ * sets and items. Strings are stored right after the record they belong to.
+ * Snapshots are only meant to be read by the same build of LavaLauncher on the
+ * same machine, so records are stored in native layout.
+ */
+#define SNAPSHOT_VERSION 1
+
+#define SNAPSHOT_FEATURE_WATCH_CONFIG (1 << 0)
+#define SNAPSHOT_FEATURE_SVG_SUPPORT  (1 << 1)
+
+#define SNAPSHOT_FLAG_WATCH             (1 << 0)
+#define SNAPSHOT_FLAG_SVG_CACHE         (1 << 1)
+#define SNAPSHOT_FLAG_NEED_KEYBOARD     (1 << 2)
+#define SNAPSHOT_FLAG_NEED_POINTER      (1 << 3)
+#define SNAPSHOT_FLAG_NEED_TOUCH        (1 << 4)
+#define SNAPSHOT_FLAG_NEED_RIVER_STATUS (1 << 5)
+
+/* Marks a NULL string. */
+#define SNAPSHOT_NULL_STRING UINT32_MAX
+
+struct Snapshot_header
+{
+	char     magic[8];
+	uint32_t version, features;
+
+	/* The config file the snapshot has been compiled from. The snapshot
+	 * is only used as long as the file is unchanged.
+	 */
+	uint64_t source_device, source_inode, source_size;
+	int64_t  source_mtime_sec, source_mtime_nsec;
+
+	uint32_t flags;
+	int32_t  swapchain_depth;
+	uint32_t bar_amount;
+};
+
+struct Snapshot_bar
+{
+	uint32_t config_amount, item_amount;
+};
+
+/* Followed by the strings only_output, namespace and cursor_name. */
+struct Snapshot_config
+{
+	uint32_t position, alignment, mode, orientation, layer;
+	uint32_t size, icon_padding;
+	udirections_t border, margin;
+	uradii_t      radii;
+	uint32_t hidden_size, hidden_mode;
+	colour_t bar_colour, border_colour;
+	uint32_t indicator_padding, indicator_style;
+	colour_t indicator_hover_colour, indicator_active_colour;
+	int32_t  exclusive_zone;
+	uint32_t condition_scale;
+	int32_t  condition_transform;
+	uint32_t condition_resolution;
+};
+
+/* Followed by the image path. */
+struct Snapshot_item
+{
+	uint32_t type, length, debounce, single_instance, command_amount;
+};
+
+/* Followed by the command. */
+struct Snapshot_command
+{
+	uint32_t type, modifiers, special;
+};
+
+static const char snapshot_magic[8] = { 'L', 'A', 'V', 'A', 'S', 'N', 'P', '1' };
+
+static uint32_t snapshot_features (void)
+{
+	uint32_t features = 0;
+#if WATCH_CONFIG
+	features |= SNAPSHOT_FEATURE_WATCH_CONFIG;
+#endif
+#if SVG_SUPPORT
+	features |= SNAPSHOT_FEATURE_SVG_SUPPORT;
+#endif
+	return features;
+}
+
+static char *get_snapshot_path (void)
+{
+	return get_formatted_buffer("%s.snapshot", context.config_path);
+}
+
+/*************
+ *           *
+ *  Writing  *
+ *           *
+ *************/
+static bool snapshot_write_string (FILE *file, const char *str)
+{
+	if ( str == NULL )
+	{
+		const uint32_t length = SNAPSHOT_NULL_STRING;
+		return fwrite(&length, sizeof(uint32_t), 1, file) == 1;
+	}
+
+	/* Strings are stored with their terminating zero. */
+	const uint32_t length = (uint32_t)strlen(str);
+	return fwrite(&length, sizeof(uint32_t), 1, file) == 1
+		&& fwrite(str, length + 1, 1, file) == 1;
+}
+
+static bool snapshot_write_config (FILE *file, struct Lava_bar_configuration *config)
+{
+	struct Snapshot_config record = {
+		.position                = config->position,
+		.alignment               = config->alignment,
+		.mode                    = config->mode,
+		.orientation             = config->orientation,
+		.layer                   = config->layer,
+		.size                    = config->size,
+		.icon_padding            = config->icon_padding,
+		.border                  = config->border,
+		.margin                  = config->margin,
+		.radii                   = config->radii,
+		.hidden_size             = config->hidden_size,
+		.hidden_mode             = config->hidden_mode,
+		.bar_colour              = config->bar_colour,
+		.border_colour           = config->border_colour,
+		.indicator_padding       = config->indicator_padding,
+		.indicator_style         = config->indicator_style,
+		.indicator_hover_colour  = config->indicator_hover_colour,
+		.indicator_active_colour = config->indicator_active_colour,
+		.exclusive_zone          = config->exclusive_zone,
+		.condition_scale         = config->condition_scale,
+		.condition_transform     = config->condition_transform,
+		.condition_resolution    = config->condition_resolution
+	};
+	return fwrite(&record, sizeof(record), 1, file) == 1
+		&& snapshot_write_string(file, config->only_output)
+		&& snapshot_write_string(file, config->namespace)
+		&& snapshot_write_string(file, config->cursor_name);
+}
+
+static bool snapshot_write_item (FILE *file, struct Lava_item *item)
+{
+	struct Snapshot_item record = {
+		.type            = item->type,
+		.length          = item->length,
+		.debounce        = item->debounce,
+		.single_instance = item->single_instance,
+		.command_amount  = (uint32_t)wl_list_length(&item->commands)
+	};
+	if ( fwrite(&record, sizeof(record), 1, file) != 1
+			|| ! snapshot_write_string(file, item->img == NULL ? NULL : item->img->path) )
+		return false;
+
+	/* Commands are written in the order they have been added in. */
+	struct Lava_item_command *cmd;
+	wl_list_for_each_reverse(cmd, &item->commands, link)
+	{
+		struct Snapshot_command command = {
+			.type      = cmd->type,
+			.modifiers = cmd->modifiers,
+			.special   = cmd->special
+		};
+		if ( fwrite(&command, sizeof(command), 1, file) != 1
+				|| ! snapshot_write_string(file, cmd->command) )
+			return false;
+	}
+
+	return true;
+}
+
+static bool snapshot_write_bar (FILE *file, struct Lava_bar *bar)
+{
+	struct Snapshot_bar record = {
+		.config_amount = (uint32_t)wl_list_length(&bar->configs),
+		.item_amount   = (uint32_t)wl_list_length(&bar->items)
+	};
+	if ( fwrite(&record, sizeof(record), 1, file) != 1 )
+		return false;
+
+	/* Configuration sets and items are written in the order they have
+	 * been created in, which is the reverse of their list order. This way
+	 * the default configuration set comes first.
+	 */
+	struct Lava_bar_configuration *config;
+	wl_list_for_each_reverse(config, &bar->configs, link)
+		if (! snapshot_write_config(file, config))
+			return false;
+
+	struct Lava_item *item;
+	wl_list_for_each_reverse(item, &bar->items, link)
+		if (! snapshot_write_item(file, item))
+			return false;
+
+	return true;
+}
+
+static bool snapshot_write_header (FILE *file, struct stat *source)
+{
+	struct Snapshot_header header = {
+		.version           = SNAPSHOT_VERSION,
+		.features          = snapshot_features(),
+		.source_device     = (uint64_t)source->st_dev,
+		.source_inode      = (uint64_t)source->st_ino,
+		.source_size       = (uint64_t)source->st_size,
+		.source_mtime_sec  = (int64_t)source->st_mtim.tv_sec,
+		.source_mtime_nsec = (int64_t)source->st_mtim.tv_nsec,
+		.flags             = 0,
+		.swapchain_depth   = context.swapchain_depth,
+		.bar_amount        = (uint32_t)wl_list_length(&context.bars)
+	};
+	memcpy(header.magic, snapshot_magic, sizeof(snapshot_magic));
+
+#if WATCH_CONFIG
+	if (context.watch)
+		header.flags |= SNAPSHOT_FLAG_WATCH;
+#endif
+#if SVG_SUPPORT
+	if (context.svg_cache)
+		header.flags |= SNAPSHOT_FLAG_SVG_CACHE;
+#endif
+	if (context.need_keyboard)
+		header.flags |= SNAPSHOT_FLAG_NEED_KEYBOARD;
+	if (context.need_pointer)
+		header.flags |= SNAPSHOT_FLAG_NEED_POINTER;
+	if (context.need_touch)
+		header.flags |= SNAPSHOT_FLAG_NEED_TOUCH;
+	if (context.need_river_status)
+		header.flags |= SNAPSHOT_FLAG_NEED_RIVER_STATUS;
+
+	return fwrite(&header, sizeof(header), 1, file) == 1;
+}
+
+/* Write a snapshot of the configuration parsed from the config file. */
+bool write_config_snapshot (void)
+{
+	errno = 0;
+	struct stat source;
+	if ( -1 == stat(context.config_path, &source) )
+	{
+		log_message(0, "ERROR: stat: %s\n", strerror(errno));
+		return false;
+	}
+
+	char *path = get_snapshot_path();
+	if ( path == NULL )
+		return false;
+
+	/* Write to a temporary file first, so a running LavaLauncher never sees
+	 * an incomplete snapshot.
+	 */
+	char *temp_path = get_formatted_buffer("%s.%ld.tmp", path, (long)getpid());
+	if ( temp_path == NULL )
+	{
+		free(path);
+		return false;
+	}
+
+	FILE *file = fopen(temp_path, "w");
+	if ( file == NULL )
+	{
+		log_message(0, "ERROR: Can not open file: %s\n"
+				"ERROR: fopen: %s\n", temp_path, strerror(errno));
+		free(temp_path);
+		free(path);
+		return false;
+	}
+
+	/* The bars are written in the order they have been created in. */
+	bool ok = snapshot_write_header(file, &source);
+	struct Lava_bar *bar;
+	wl_list_for_each_reverse(bar, &context.bars, link)
+		if (! (ok = ok && snapshot_write_bar(file, bar)))
+			break;
+	ok = ( fclose(file) == 0 ) && ok;
+
+	if ( ! ok || -1 == rename(temp_path, path) )
+	{
+		log_message(0, "ERROR: Can not write snapshot: %s\n", path);
+		unlink(temp_path);
+		ok = false;
+	}
+	else
+		log_message(1, "[snapshot] Wrote snapshot: %s\n", path);
+
+	free(temp_path);
+	free(path);
+	return ok;
+}
+
+/*************
+ *           *
+ *  Reading  *
+ *           *
+ *************/
+struct Snapshot_reader
+{
+	const unsigned char *data;
+	size_t size, position;
+};
+
+static bool snapshot_read (struct Snapshot_reader *reader, void *record, size_t size)
+{
+	if ( reader->size - reader->position < size )
+	{
+		log_message(0, "ERROR: Snapshot is truncated.\n");
+		return false;
+	}
+	memcpy(record, reader->data + reader->position, size);
+	reader->position += size;
+	return true;
+}
+
+/* Returns a pointer into the mapping, which must be copied to be kept. */
+static bool snapshot_read_string (struct Snapshot_reader *reader, const char **str)
+{
+	uint32_t length;
+	if (! snapshot_read(reader, &length, sizeof(uint32_t)))
+		return false;
+
+	if ( length == SNAPSHOT_NULL_STRING )
+	{
+		*str = NULL;
+		return true;
+	}
+
+	if ( reader->size - reader->position < (size_t)length + 1
+			|| reader->data[reader->position + length] != '\0' )
+	{
+		log_message(0, "ERROR: Snapshot contains a malformed string.\n");
+		return false;
+	}
+	*str = (const char *)(reader->data + reader->position);
+	reader->position += (size_t)length + 1;
+	return true;
+}
+
+static bool snapshot_read_owned_string (struct Snapshot_reader *reader, char **str)
+{
+	const char *view;
+	if (! snapshot_read_string(reader, &view))
+		return false;
+	free_if_set(*str);
+	*str = NULL;
+	if ( view != NULL && NULL == (*str = strdup(view)) )
+	{
+		log_message(0, "ERROR: Can not allocate.\n");
+		return false;
+	}
+	return true;
+}
+
+static bool snapshot_load_config (struct Snapshot_reader *reader, struct Lava_bar *bar, bool first)
+{
+	if ( ! first && ! create_bar_config(bar, false) )
+		return false;
+	struct Lava_bar_configuration *config = bar->last_config;
+
+	struct Snapshot_config record;
+	if (! snapshot_read(reader, &record, sizeof(record)))
+		return false;
+
+	/* The file may be damaged or written by something else, so values which
+	 * are used to index or switch on must be checked just like when parsing.
+	 */
+	if ( record.position > POSITION_LEFT
+			|| record.alignment > ALIGNMENT_END
+			|| record.mode > MODE_AGGRESSIVE
+			|| record.orientation > ORIENTATION_HORIZONTAL
+			|| record.layer > ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY
+			|| record.hidden_mode > HIDDEN_MODE_RIVER_AUTO
+			|| record.indicator_style > STYLE_CIRCLE
+			|| record.condition_transform < -1 || record.condition_transform > 4
+			|| record.condition_resolution > RESOLUTION_ALL )
+	{
+		log_message(0, "ERROR: Snapshot contains an invalid configuration set.\n");
+		return false;
+	}
+
+	config->position                = record.position;
+	config->alignment               = record.alignment;
+	config->mode                    = record.mode;
+	config->orientation             = record.orientation;
+	config->layer                   = record.layer;
+	config->size                    = record.size;
+	config->icon_padding            = record.icon_padding;
+	config->border                  = record.border;
+	config->margin                  = record.margin;
+	config->radii                   = record.radii;
+	config->hidden_size             = record.hidden_size;
+	config->hidden_mode             = record.hidden_mode;
+	config->bar_colour              = record.bar_colour;
+	config->border_colour           = record.border_colour;
+	config->indicator_padding       = record.indicator_padding;
+	config->indicator_style         = record.indicator_style;
+	config->indicator_hover_colour  = record.indicator_hover_colour;
+	config->indicator_active_colour = record.indicator_active_colour;
+	config->exclusive_zone          = record.exclusive_zone;
+	config->condition_scale         = record.condition_scale;
+	config->condition_transform     = record.condition_transform;
+	config->condition_resolution    = record.condition_resolution;
+
+	return snapshot_read_owned_string(reader, &config->only_output)
+		&& snapshot_read_owned_string(reader, &config->namespace)
+		&& snapshot_read_owned_string(reader, &config->cursor_name);
+}
+
+static bool snapshot_load_item (struct Snapshot_reader *reader, struct Lava_bar *bar)
+{
+	struct Snapshot_item record;
+	if (! snapshot_read(reader, &record, sizeof(record)))
+		return false;
+
+	if ( record.type != TYPE_BUTTON && record.type != TYPE_SPACER )
+	{
+		log_message(0, "ERROR: Snapshot contains an item of unknown type.\n");
+		return false;
+	}
+	if (! create_item(bar, record.type))
+		return false;
+
+	struct Lava_item *item = bar->last_item;
+	item->length          = record.length;
+	item->debounce        = record.debounce;
+	item->single_instance = record.single_instance != 0;
+
+	const char *path;
+	if (! snapshot_read_string(reader, &path))
+		return false;
+	if ( path != NULL && NULL == (item->img = image_t_create_from_file(path)) )
+		return false;
+
+	for (uint32_t i = 0; i < record.command_amount; i++)
+	{
+		struct Snapshot_command command;
+		const char *str;
+		if ( ! snapshot_read(reader, &command, sizeof(command))
+				|| ! snapshot_read_string(reader, &str) || str == NULL
+				|| ! item_add_command(item, str, command.type,
+					command.modifiers, command.special) )
+			return false;
+	}
+
+	return true;
+}
+
+static bool snapshot_load_bar (struct Snapshot_reader *reader)
+{
+	struct Snapshot_bar record;
+	if ( ! snapshot_read(reader, &record, sizeof(record)) || ! create_bar() )
+		return false;
+	struct Lava_bar *bar = context.last_bar;
+
+	if ( record.config_amount == 0 )
+	{
+		log_message(0, "ERROR: Snapshot contains a bar without configuration.\n");
+		return false;
+	}
+
+	/* The default configuration set has been created with the bar. */
+	for (uint32_t i = 0; i < record.config_amount; i++)
+		if (! snapshot_load_config(reader, bar, i == 0))
+			return false;
+
+	for (uint32_t i = 0; i < record.item_amount; i++)
+		if (! snapshot_load_item(reader, bar))
+			return false;
+
+	return finalize_bar(bar);
+}
+
+static bool snapshot_load (struct Snapshot_reader *reader, struct stat *source)
+{
+	struct Snapshot_header header;
+	if (! snapshot_read(reader, &header, sizeof(header)))
+		return false;
+
+	if ( memcmp(header.magic, snapshot_magic, sizeof(snapshot_magic))
+			|| header.version != SNAPSHOT_VERSION
+			|| header.features != snapshot_features() )
+	{
+		log_message(1, "[snapshot] Snapshot has been written by a different "
+				"version or build of LavaLauncher; Ignoring it.\n");
+		return false;
+	}
+
+	if ( header.source_device != (uint64_t)source->st_dev
+			|| header.source_inode != (uint64_t)source->st_ino
+			|| header.source_size != (uint64_t)source->st_size
+			|| header.source_mtime_sec != (int64_t)source->st_mtim.tv_sec
+			|| header.source_mtime_nsec != (int64_t)source->st_mtim.tv_nsec )
+	{
+		log_message(0, "WARNING: Config file has changed since the snapshot "
+				"was compiled; Parsing it instead.\n");
+		return false;
+	}
+
+	if ( header.swapchain_depth < SWAPCHAIN_MIN_DEPTH
+			|| header.swapchain_depth > SWAPCHAIN_MAX_DEPTH )
+	{
+		log_message(0, "ERROR: Snapshot contains an invalid swapchain depth.\n");
+		return false;
+	}
+
+	for (uint32_t i = 0; i < header.bar_amount; i++)
+		if (! snapshot_load_bar(reader))
+			return false;
+
+	if ( reader->position != reader->size )
+	{
+		log_message(0, "ERROR: Snapshot has trailing data.\n");
+		return false;
+	}
+
+	context.need_keyboard     = header.flags & SNAPSHOT_FLAG_NEED_KEYBOARD;
+	context.need_pointer      = header.flags & SNAPSHOT_FLAG_NEED_POINTER;
+	context.need_touch        = header.flags & SNAPSHOT_FLAG_NEED_TOUCH;
+	context.need_river_status = header.flags & SNAPSHOT_FLAG_NEED_RIVER_STATUS;
+
+	stage_global_settings(header.swapchain_depth,
+			header.flags & SNAPSHOT_FLAG_WATCH,
+			header.flags & SNAPSHOT_FLAG_SVG_CACHE);
+	apply_global_settings();
+
+	return true;
+}
+
+/* Load the configuration from its snapshot instead of parsing the config file.
+ * Returns false if there is no usable snapshot, in which case nothing has been
+ * loaded and the config file must be parsed.
+ */
+bool load_config_snapshot (void)
+{
+	char *path = get_snapshot_path();
+	if ( path == NULL )
+		return false;
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	free(path);
+	if ( fd == -1 )
+		return false;
+
+	struct stat source, snapshot;
+	if ( -1 == fstat(fd, &snapshot) || snapshot.st_size == 0
+			|| -1 == stat(context.config_path, &source) )
+	{
+		close(fd);
+		return false;
+	}
+
+	struct Snapshot_reader reader = {
+		.data     = mmap(NULL, (size_t)snapshot.st_size, PROT_READ, MAP_PRIVATE, fd, 0),
+		.size     = (size_t)snapshot.st_size,
+		.position = 0
+	};
+	close(fd);
+	if ( reader.data == MAP_FAILED )
+		return false;
+
+	log_message(1, "[snapshot] Loading snapshot.\n");
+	const bool ret = snapshot_load(&reader, &source);
+	munmap((void *)reader.data, reader.size);
+
+	/* A partially loaded configuration is thrown away. */
+	if (! ret)
+	{
+		destroy_all_bars();
+		context.last_bar = NULL;
+	}
+
+	return ret;
+}
+
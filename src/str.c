@@ -101,3 +101,11 @@ bool string_starts_with(const char *str, const char *prefix)
 	return strncmp(prefix, str, strlen(prefix)) == 0;
 }
 
+/* Compare two strings, either of which may be NULL. */
+bool string_equal (const char *a, const char *b)
+{
+	if ( a == NULL || b == NULL )
+		return a == b;
+	return strcmp(a, b) == 0;
+}
+
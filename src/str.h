@@ -29,6 +29,7 @@ char *get_formatted_buffer (const char *fmt, ...);
 const char *str_orelse (const char *str, const char *orelse);
 void setenvf (const char *name, const char *fmt, ...);
 bool string_starts_with(const char *str, const char *prefix);
+bool string_equal (const char *a, const char *b);
 
 #endif
 
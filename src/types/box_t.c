@@ -38,6 +38,11 @@ ubox_t ubox_t_scale (ubox_t *in, uint32_t scale)
 	return out;
 }
 
+bool ubox_t_equal (ubox_t *a, ubox_t *b)
+{
+	return a->x == b->x && a->y == b->y && a->w == b->w && a->h == b->h;
+}
+
 void udirections_t_set_all (udirections_t *box, uint32_t val)
 {
 	box->top    = val;
@@ -57,6 +62,12 @@ udirections_t udirections_t_scale (udirections_t *in, uint32_t scale)
 	return out;
 }
 
+bool udirections_t_equal (udirections_t *a, udirections_t *b)
+{
+	return a->top == b->top && a->right == b->right
+		&& a->bottom == b->bottom && a->left == b->left;
+}
+
 void uradii_t_set_all (uradii_t *box, uint32_t val)
 {
 	box->top_left     = val;
@@ -76,3 +87,9 @@ uradii_t uradii_t_scale (uradii_t *in, uint32_t scale)
 	return out;
 }
 
+bool uradii_t_equal (uradii_t *a, uradii_t *b)
+{
+	return a->top_left == b->top_left && a->top_right == b->top_right
+		&& a->bottom_left == b->bottom_left && a->bottom_right == b->bottom_right;
+}
+
@@ -21,6 +21,7 @@
 #define LAVALAUNCHER_BOX_T_H
 
 #include<stdint.h>
+#include<stdbool.h>
 
 /* Various "box" type structs, containing four values each. */
 
@@ -41,10 +42,13 @@ typedef struct
 
 void ubox_t_set_all (ubox_t *box, uint32_t val);
 ubox_t ubox_t_scale (ubox_t *in, uint32_t scale);
+bool ubox_t_equal (ubox_t *a, ubox_t *b);
 void udirections_t_set_all (udirections_t *box, uint32_t val);
 udirections_t udirections_t_scale (udirections_t *in, uint32_t scale);
+bool udirections_t_equal (udirections_t *a, udirections_t *b);
 void uradii_t_set_all (uradii_t *box, uint32_t val);
 uradii_t uradii_t_scale (uradii_t *in, uint32_t scale);
+bool uradii_t_equal (uradii_t *a, uradii_t *b);
 
 #endif
 
@@ -17,7 +17,11 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#if HAVE_MEMFD
+#define _GNU_SOURCE
+#else
 #define _POSIX_C_SOURCE 200809L
+#endif
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -31,6 +35,7 @@
 
 #include"buffer.h"
 #include"str.h"
+#include"lavalauncher.h"
 
 static void randomize_string (char *str, size_t len)
 {
@@ -50,7 +55,7 @@ static void randomize_string (char *str, size_t len)
 }
 
 /* Tries to create a shared memory object and returns its file descriptor if
- * successful.
+ * successful. Only used if memfd_create() is not available.
  */
 static bool get_shm_fd (int *fd, size_t size)
 {
@@ -99,18 +104,233 @@ static bool get_shm_fd (int *fd, size_t size)
 	return false;
 }
 
+static int create_pool_fd (void)
+{
+	int fd;
+#if HAVE_MEMFD
+	if ( -1 != (fd = memfd_create("lavalauncher-shm", MFD_CLOEXEC)) )
+		return fd;
+	log_message(1, "[buffer] memfd_create failed, falling back to shm_open: %s\n",
+			strerror(errno));
+#endif
+	if (! get_shm_fd(&fd, 0))
+		return -1;
+	return fd;
+}
+
+/* Amount of address space reserved for each pool. The pool can not grow
+ * beyond this size.
+ */
+#define SHM_POOL_RESERVED ( SIZE_MAX > UINT32_MAX ? 256 * 1024 * 1024 : 32 * 1024 * 1024 )
+#define SHM_POOL_MIN_GROW ( 256 * 1024 )
+#define SHM_BLOCK_ALIGN   64
+
+struct Lava_shm_block
+{
+	struct wl_list link;
+	size_t offset, size;
+};
+
+struct Lava_retired_buffer
+{
+	struct wl_list     link;
+	struct Lava_buffer buffer;
+};
+
+void init_shm_pool (struct Lava_shm_pool *pool)
+{
+	pool->pool     = NULL;
+	pool->fd       = -1;
+	pool->memory   = NULL;
+	pool->size     = 0;
+	pool->reserved = 0;
+	wl_list_init(&pool->free_blocks);
+	wl_list_init(&pool->retired_buffers);
+}
+
+void finish_shm_pool (struct Lava_shm_pool *pool)
+{
+	/* The pool goes away, so the compositor can not use these anymore. */
+	struct Lava_retired_buffer *retired, *temp_retired;
+	wl_list_for_each_safe(retired, temp_retired, &pool->retired_buffers, link)
+	{
+		wl_list_remove(&retired->link);
+		retired->buffer.busy = false;
+		finish_buffer(&retired->buffer);
+		free(retired);
+	}
+
+	if ( pool->pool != NULL )
+		wl_shm_pool_destroy(pool->pool);
+	if ( pool->memory != NULL )
+		munmap(pool->memory, pool->reserved);
+	if ( pool->fd != -1 )
+		close(pool->fd);
+
+	struct Lava_shm_block *block, *temp;
+	wl_list_for_each_safe(block, temp, &pool->free_blocks, link)
+	{
+		wl_list_remove(&block->link);
+		free(block);
+	}
+
+	init_shm_pool(pool);
+}
+
+/* Give a range of the pool back, merging it with adjacent free blocks. */
+static bool shm_pool_free (struct Lava_shm_pool *pool, size_t offset, size_t size)
+{
+	/* Find the first free block after the range. */
+	struct Lava_shm_block *next;
+	wl_list_for_each(next, &pool->free_blocks, link)
+		if ( next->offset > offset )
+			break;
+
+	struct Lava_shm_block *prev = NULL;
+	if ( next->link.prev != &pool->free_blocks )
+		prev = wl_container_of(next->link.prev, prev, link);
+	const bool has_next = &next->link != &pool->free_blocks;
+
+	if ( prev != NULL && prev->offset + prev->size == offset )
+	{
+		prev->size += size;
+		if ( has_next && prev->offset + prev->size == next->offset )
+		{
+			prev->size += next->size;
+			wl_list_remove(&next->link);
+			free(next);
+		}
+		return true;
+	}
+
+	if ( has_next && offset + size == next->offset )
+	{
+		next->offset  = offset;
+		next->size   += size;
+		return true;
+	}
+
+	TRY_NEW(struct Lava_shm_block, block, false);
+	block->offset = offset;
+	block->size   = size;
+	wl_list_insert(next->link.prev, &block->link);
+	return true;
+}
+
+/* Grow the pool by at least the given amount of bytes. */
+static bool shm_pool_grow (struct Lava_shm_pool *pool, struct wl_shm *shm, size_t amount)
+{
+	if ( pool->fd == -1 )
+	{
+		if ( -1 == (pool->fd = create_pool_fd()) )
+			return false;
+
+		/* Reserve address space for the entire pool. Nothing beyond
+		 * the current size of the pool is mapped accessibly.
+		 */
+		pool->reserved = SHM_POOL_RESERVED;
+		if ( MAP_FAILED == (pool->memory = mmap(NULL, pool->reserved,
+						PROT_NONE, MAP_SHARED, pool->fd, 0)) )
+		{
+			log_message(0, "ERROR: mmap: %s\n", strerror(errno));
+			pool->memory = NULL;
+			return false;
+		}
+	}
+
+	const size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+	size_t new_size = pool->size + ( amount > SHM_POOL_MIN_GROW ? amount : SHM_POOL_MIN_GROW );
+	if ( new_size < pool->size * 2 )
+		new_size = pool->size * 2;
+	new_size = (new_size + page_size - 1) / page_size * page_size;
+	if ( new_size > pool->reserved )
+		new_size = pool->reserved;
+	if ( new_size - pool->size < amount )
+	{
+		log_message(0, "ERROR: Shared memory pool is exhausted.\n");
+		return false;
+	}
+
+	log_message(2, "[buffer] Growing shared memory pool: %zu -> %zu\n",
+			pool->size, new_size);
+
+	if ( ftruncate(pool->fd, (off_t)new_size) < 0 )
+	{
+		log_message(0, "ERROR: ftruncate: %s\n", strerror(errno));
+		return false;
+	}
+	if ( MAP_FAILED == mmap(pool->memory, new_size, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_FIXED, pool->fd, 0) )
+	{
+		log_message(0, "ERROR: mmap: %s\n", strerror(errno));
+		return false;
+	}
+
+	if ( pool->pool == NULL )
+		pool->pool = wl_shm_create_pool(shm, pool->fd, (int32_t)new_size);
+	else
+		wl_shm_pool_resize(pool->pool, (int32_t)new_size);
+
+	const size_t old_size = pool->size;
+	pool->size = new_size;
+	return shm_pool_free(pool, old_size, new_size - old_size);
+}
+
+/* First-fit allocation from the free blocks of the pool. */
+static bool shm_pool_alloc (struct Lava_shm_pool *pool, struct wl_shm *shm,
+		size_t size, size_t *offset)
+{
+	struct Lava_shm_block *block;
+	wl_list_for_each(block, &pool->free_blocks, link)
+	{
+		if ( block->size < size )
+			continue;
+
+		*offset        = block->offset;
+		block->offset += size;
+		block->size   -= size;
+		if ( block->size == 0 )
+		{
+			wl_list_remove(&block->link);
+			free(block);
+		}
+		return true;
+	}
+
+	/* A free block at the end of the pool will be merged with the new space. */
+	size_t amount = size;
+	if (! wl_list_empty(&pool->free_blocks))
+	{
+		block = wl_container_of(pool->free_blocks.prev, block, link);
+		if ( block->offset + block->size == pool->size )
+			amount -= block->size;
+	}
+
+	if (! shm_pool_grow(pool, shm, amount))
+		return false;
+	return shm_pool_alloc(pool, shm, size, offset);
+}
+
 static void buffer_handle_release (void *data, struct wl_buffer *wl_buffer)
 {
 	struct Lava_buffer *buffer = (struct Lava_buffer *)data;
 	buffer->busy               = false;
+
+	if (buffer->retired)
+	{
+		struct Lava_retired_buffer *retired = wl_container_of(buffer, retired, buffer);
+		wl_list_remove(&retired->link);
+		finish_buffer(buffer);
+		free(retired);
+	}
 }
 
 static const struct wl_buffer_listener buffer_listener = {
 	.release = buffer_handle_release,
 };
 
-static bool create_buffer (struct wl_shm *shm, struct Lava_buffer *buffer,
-		uint32_t _w, uint32_t _h)
+bool create_buffer (struct wl_shm *shm, struct Lava_shm_pool *pool,
+		struct Lava_buffer *buffer, uint32_t _w, uint32_t _h)
 {
 	int32_t w = (int32_t)_w, h = (int32_t)_h;
 
@@ -122,84 +342,133 @@ static bool create_buffer (struct wl_shm *shm, struct Lava_buffer *buffer,
 
 	buffer->w    = _w;
 	buffer->h    = _h;
-	buffer->size = size;
+	buffer->pool = NULL;
+	buffer->size = 0;
 
 	if ( size == 0 )
 	{
-		buffer->memory_object = NULL;
-		buffer->surface       = NULL;
-		buffer->cairo         = NULL;
+		buffer->surface = NULL;
+		buffer->cairo   = NULL;
 		return true;
 	}
 
-	int fd;
-	if (! get_shm_fd(&fd, size))
+	size = (size + SHM_BLOCK_ALIGN - 1) / SHM_BLOCK_ALIGN * SHM_BLOCK_ALIGN;
+	if (! shm_pool_alloc(pool, shm, size, &buffer->offset))
 		return false;
+	buffer->pool = pool;
+	buffer->size = size;
 
-	errno = 0;
-	if ( MAP_FAILED == (buffer->memory_object = mmap(NULL, size,
-					PROT_READ | PROT_WRITE, MAP_SHARED,
-					fd, 0)) )
-	{
-		close(fd);
-		log_message(0, "ERROR: mmap: %s\n", strerror(errno));
-		return false;
-	}
-
-	struct wl_shm_pool *pool = wl_shm_create_pool(shm, fd, (int32_t)size);
-	buffer->buffer = wl_shm_pool_create_buffer(pool, 0, w, h, stride,
-			wl_fmt);
+	buffer->buffer = wl_shm_pool_create_buffer(pool->pool, (int32_t)buffer->offset,
+			w, h, stride, wl_fmt);
 	wl_buffer_add_listener(buffer->buffer, &buffer_listener, buffer);
-	wl_shm_pool_destroy(pool);
-
-	close(fd);
 
 	buffer->surface = cairo_image_surface_create_for_data(
-		buffer->memory_object, cairo_fmt, w, h, stride);
+		pool->memory + buffer->offset, cairo_fmt, w, h, stride);
 	buffer->cairo = cairo_create(buffer->surface);
 
 	return true;
 }
 
+/* Hand a buffer the compositor still holds over to its pool. The wl_buffer and
+ * its block of the pool are kept until the compositor releases it.
+ */
+static bool retire_buffer (struct Lava_buffer *buffer)
+{
+	TRY_NEW(struct Lava_retired_buffer, retired, false);
+	retired->buffer         = *buffer;
+	retired->buffer.retired = true;
+	wl_buffer_set_user_data(buffer->buffer, &retired->buffer);
+	wl_list_insert(&buffer->pool->retired_buffers, &retired->link);
+	return true;
+}
+
 void finish_buffer (struct Lava_buffer *buffer)
 {
-	if (buffer->buffer)
-		wl_buffer_destroy(buffer->buffer);
 	if (buffer->cairo)
 		cairo_destroy(buffer->cairo);
 	if (buffer->surface)
 		cairo_surface_destroy(buffer->surface);
-	if (buffer->memory_object)
-		munmap(buffer->memory_object, buffer->size);
+	buffer->cairo   = NULL;
+	buffer->surface = NULL;
+
+	if ( buffer->busy && ! buffer->retired && buffer->buffer != NULL
+			&& buffer->pool != NULL && retire_buffer(buffer) )
+	{
+		memset(buffer, 0, sizeof(struct Lava_buffer));
+		return;
+	}
+
+	if (buffer->buffer)
+		wl_buffer_destroy(buffer->buffer);
+	if (buffer->pool)
+		shm_pool_free(buffer->pool, buffer->offset, buffer->size);
 	memset(buffer, 0, sizeof(struct Lava_buffer));
 }
 
-bool next_buffer (struct Lava_buffer **buffer, struct wl_shm *shm,
-		struct Lava_buffer buffers[static 2], uint32_t w, uint32_t h)
+void init_swapchain (struct Lava_swapchain *swapchain, int depth)
 {
-	/* Check if buffers are busy and use first non-busy one, if it exists.
-	 * If all buffers are busy, exit.
-	 */
-	if (! buffers[0].busy)
-		*buffer = &buffers[0];
-	else if (! buffers[1].busy)
-		*buffer = &buffers[1];
-	else
+	memset(swapchain, 0, sizeof(struct Lava_swapchain));
+	if ( depth < SWAPCHAIN_MIN_DEPTH )
+		depth = SWAPCHAIN_MIN_DEPTH;
+	else if ( depth > SWAPCHAIN_MAX_DEPTH )
+		depth = SWAPCHAIN_MAX_DEPTH;
+	swapchain->depth = depth;
+}
+
+void finish_swapchain (struct Lava_swapchain *swapchain)
+{
+	for (int i = 0; i < swapchain->depth; i++)
+		finish_buffer(&swapchain->buffers[i]);
+	swapchain->current = NULL;
+}
+
+/* Makes the next buffer to draw into the current one. Of the buffers not held
+ * by the compositor, the one with the most recent contents and the right
+ * dimensions is preferred, so partial redraws have the least work to do.
+ */
+bool swapchain_next_buffer (struct Lava_swapchain *swapchain, struct wl_shm *shm,
+		struct Lava_shm_pool *pool, uint32_t w, uint32_t h)
+{
+	struct Lava_buffer *best = NULL;
+	for (int i = 0; i < swapchain->depth; i++)
 	{
-		log_message(0, "ERROR: All buffers are busy.\n");
-		*buffer = NULL;
+		struct Lava_buffer *buffer = &swapchain->buffers[i];
+		if (buffer->busy)
+			continue;
+
+		const bool usable      = buffer->buffer != NULL && buffer->w == w && buffer->h == h;
+		const bool best_usable = best != NULL && best->buffer != NULL
+			&& best->w == w && best->h == h;
+		if ( best == NULL || ( usable && ! best_usable )
+				|| ( usable && best_usable && buffer->frame > best->frame ) )
+			best = buffer;
+	}
+
+	if ( best == NULL )
+	{
+		log_message(1, "[buffer] All %d buffers are busy.\n", swapchain->depth);
 		return false;
 	}
 
 	/* If the buffers dimensions do not match, or if there is no wl_buffer
 	 * or if the buffer does not exist, close it and create a new one.
 	 */
-	if ( (*buffer)->w != w || (*buffer)->h != h || ! (*buffer)->buffer )
+	if ( best->w != w || best->h != h || ! best->buffer )
 	{
-		finish_buffer(*buffer);
-		if (! create_buffer(shm, *buffer, w, h))
+		finish_buffer(best);
+		if (! create_buffer(shm, pool, best, w, h))
 			return false;
 	}
 
+	swapchain->current = best;
 	return true;
 }
+
+/* Attach the current buffer, which the compositor holds until releasing it. */
+void swapchain_attach (struct Lava_swapchain *swapchain, struct wl_surface *surface)
+{
+	struct Lava_buffer *buffer = swapchain->current;
+	wl_surface_attach(surface, buffer == NULL ? NULL : buffer->buffer, 0, 0);
+	if ( buffer != NULL && buffer->buffer != NULL )
+		buffer->busy = true;
+}
@@ -25,20 +25,68 @@
 #include<cairo/cairo.h>
 #include<wayland-client.h>
 
+/* A shared memory pool from which buffers are sub-allocated. The pool reserves
+ * address space up front, so it can grow in place without invalidating the
+ * memory of existing buffers.
+ */
+struct Lava_shm_pool
+{
+	struct wl_shm_pool *pool;
+	int                 fd;
+	unsigned char      *memory;
+	size_t              size, reserved;
+
+	/* Free blocks, sorted by offset. */
+	struct wl_list      free_blocks;
+
+	/* Buffers which were finished while still held by the compositor.
+	 * Their blocks are only given back once the compositor releases them.
+	 */
+	struct wl_list      retired_buffers;
+};
+
 struct Lava_buffer
 {
-	struct wl_buffer *buffer;
-	cairo_surface_t  *surface;
-	cairo_t          *cairo;
-	uint32_t          w;
-	uint32_t          h;
-	void             *memory_object;
-	size_t            size;
-	bool              busy;
+	struct wl_buffer     *buffer;
+	cairo_surface_t      *surface;
+	cairo_t              *cairo;
+	uint32_t              w;
+	uint32_t              h;
+	struct Lava_shm_pool *pool;
+	size_t                offset;
+	size_t                size;
+	bool                  busy;
+	bool                  retired;
+
+	/* Number of the frame currently drawn into the buffer, used by users
+	 * of the buffer for partial redraws. Zero for undefined contents.
+	 */
+	uint64_t              frame;
+};
+
+#define SWAPCHAIN_MIN_DEPTH     2
+#define SWAPCHAIN_MAX_DEPTH     8
+#define SWAPCHAIN_DEFAULT_DEPTH 3
+
+/* A set of buffers for a surface. Buffers are only created once they are
+ * needed, so the depth is just an upper limit.
+ */
+struct Lava_swapchain
+{
+	struct Lava_buffer  buffers[SWAPCHAIN_MAX_DEPTH];
+	struct Lava_buffer *current;
+	int                 depth;
 };
 
-bool next_buffer (struct Lava_buffer **buffer, struct wl_shm *shm,
-		struct Lava_buffer buffers[static 2], uint32_t w, uint32_t h);
+void init_shm_pool (struct Lava_shm_pool *pool);
+void finish_shm_pool (struct Lava_shm_pool *pool);
+bool create_buffer (struct wl_shm *shm, struct Lava_shm_pool *pool,
+		struct Lava_buffer *buffer, uint32_t w, uint32_t h);
 void finish_buffer (struct Lava_buffer *buffer);
+void init_swapchain (struct Lava_swapchain *swapchain, int depth);
+void finish_swapchain (struct Lava_swapchain *swapchain);
+bool swapchain_next_buffer (struct Lava_swapchain *swapchain, struct wl_shm *shm,
+		struct Lava_shm_pool *pool, uint32_t w, uint32_t h);
+void swapchain_attach (struct Lava_swapchain *swapchain, struct wl_surface *surface);
 
 #endif
@@ -101,3 +101,8 @@ void colour_t_set_cairo_source (cairo_t *cairo, colour_t *colour)
 	cairo_set_source_rgba(cairo, colour->r, colour->g, colour->b, colour->a);
 }
 
+bool colour_t_equal (colour_t *a, colour_t *b)
+{
+	return a->r == b->r && a->g == b->g && a->b == b->b && a->a == b->a;
+}
+
@@ -32,6 +32,7 @@ typedef struct
 
 bool colour_t_from_string (colour_t *colour, const char *str);
 void colour_t_set_cairo_source (cairo_t *cairo, colour_t *colour);
+bool colour_t_equal (colour_t *a, colour_t *b);
 
 #endif
 
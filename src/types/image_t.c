@@ -17,7 +17,7 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-#define _POSIX_C_SOURCE 200809L
+#define _XOPEN_SOURCE 700
 
 #include<stdio.h>
 #include<stdlib.h>
@@ -25,7 +25,13 @@
 #include<stdint.h>
 #include<unistd.h>
 #include<string.h>
+#include<strings.h>
+#include<ctype.h>
 #include<errno.h>
+#include<sys/stat.h>
+#include<sys/mman.h>
+#include<fcntl.h>
+#include<inttypes.h>
 #include<cairo/cairo.h>
 
 #if SVG_SUPPORT
@@ -69,6 +75,78 @@ static int is_png_file (const char *path)
 	return 1;
 }
 
+#if SVG_SUPPORT
+static bool has_svg_extension (const char *path)
+{
+	const char *dot = strrchr(path, '.');
+	return dot != NULL && ( ! strcasecmp(dot, ".svg") || ! strcasecmp(dot, ".svgz") );
+}
+
+/* Returns: -1 On error
+ *           0 If the file is not an SVG file
+ *           1 If the file is an SVG file
+ *
+ * Only the start of the file is read. Compressed files are recognized by the
+ * gzip magic and plain ones by starting with markup. Since the XML prolog may
+ * be arbitrarily long, files with one of the SVG extensions are trusted,
+ * other files need the svg element to be near the start.
+ */
+static int is_svg_file (const char *path)
+{
+	const size_t buffer_size = 512;
+
+	FILE *file;
+	if ( NULL == (file = fopen(path, "r")) )
+	{
+		log_message(0, "ERROR: Can not open file: %s\n"
+				"ERROR: fopen: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	char buffer[buffer_size + 1];
+	size_t ret = fread(buffer, sizeof(char), buffer_size, file);
+	fclose(file);
+	buffer[ret] = '\0';
+
+	if ( ret >= 2 && (unsigned char)buffer[0] == 0x1f && (unsigned char)buffer[1] == 0x8b )
+		return has_svg_extension(path) ? 1 : 0;
+
+	/* Skip a byte order mark and leading whitespace. */
+	const char *start = buffer;
+	if (! strncmp(start, "\xEF\xBB\xBF", 3))
+		start += 3;
+	while (isspace((unsigned char)*start))
+		start++;
+	if ( *start != '<' )
+		return 0;
+
+	if ( has_svg_extension(path) || strstr(start, "<svg") != NULL )
+		return 1;
+	return 0;
+}
+
+static bool load_svg_handle (image_t *image)
+{
+	if ( image->rsvg_handle != NULL )
+		return true;
+
+	log_message(2, "[image] Parsing SVG image: %s\n", image->path);
+
+	GError *gerror = NULL;
+	if ( NULL != (image->rsvg_handle = rsvg_handle_new_from_file(image->path, &gerror)) )
+		return true;
+
+	log_message(0, "ERROR: Failed to load image: %s\n"
+			"ERROR: rsvg_handle_new_from_file: %d: %s\n",
+			image->path, gerror->domain, gerror->message);
+	g_error_free(gerror);
+
+	/* Do not try again every frame. */
+	image->svg = false;
+	return false;
+}
+#endif
+
 static bool load_image (image_t *image, const char *path)
 {
 	if (access(path, F_OK))
@@ -83,11 +161,6 @@ static bool load_image (image_t *image, const char *path)
 				path);
 		return false;
 	}
-	if ( errno != 0 )
-	{
-		log_message(0, "ERROR: access: %s\n", strerror(errno));
-		return false;
-	}
 
 	/* PNG */
 	int ret;
@@ -108,21 +181,17 @@ static bool load_image (image_t *image, const char *path)
 		return false;
 
 #if SVG_SUPPORT
-	/* SVG */
-	GError *gerror = NULL;
-	if ( NULL != (image->rsvg_handle = rsvg_handle_new_from_file(path, &gerror)) )
+	/* SVG. The file is only parsed once it actually needs to be rendered
+	 * and the rendered image is not in the raster cache.
+	 */
+	ret = is_svg_file(path);
+	if ( ret == 1 )
+	{
+		image->svg = true;
 		return true;
-	else if ( gerror->domain != 123 )
-	{
-		/* The domain 123 is an XML parse error. Receiving it means that
-		 * the file is likely not an SVG image, a case which must be
-		 * handled differently than other errors.
-		 */
-		log_message(0, "ERROR: Failed to load image: %s\n"
-				"ERROR: rsvg_handle_new_from_file: %d: %s\n",
-				path, gerror->domain, gerror->message);
-		return false;
 	}
+	else if ( ret == -1 )
+		return false;
 #endif
 
 	log_message(0, "ERROR: Unsupported file type: %s\n"
@@ -137,21 +206,90 @@ static bool load_image (image_t *image, const char *path)
 	return false;
 }
 
+/* The cache holds one reference to each of its images. Images which are only
+ * referenced by the cache are evicted by image_t_cache_sweep().
+ */
+static struct
+{
+	image_t *images;
+	unsigned long hits, misses, evictions;
+} cache = { NULL, 0, 0, 0 };
+
+static bool cache_key_equal (image_t *image, const char *path, struct stat *stat_buffer)
+{
+	return image->device == stat_buffer->st_dev
+		&& image->inode == stat_buffer->st_ino
+		&& image->mtime.tv_sec == stat_buffer->st_mtim.tv_sec
+		&& image->mtime.tv_nsec == stat_buffer->st_mtim.tv_nsec
+		&& ! strcmp(image->path, path);
+}
+
 image_t *image_t_create_from_file (const char *path)
 {
-	TRY_NEW(image_t, image, NULL);
+	char *canonical_path = realpath(path, NULL);
+	if ( canonical_path == NULL )
+	{
+		if ( errno == ENOENT )
+			log_message(0, "ERROR: File does not exist: %s\n", path);
+		else
+			log_message(0, "ERROR: Can not resolve path: %s\n"
+					"ERROR: realpath: %s\n", path, strerror(errno));
+		return NULL;
+	}
+
+	struct stat stat_buffer;
+	if ( -1 == stat(canonical_path, &stat_buffer) )
+	{
+		log_message(0, "ERROR: stat: %s\n", strerror(errno));
+		free(canonical_path);
+		return NULL;
+	}
+
+	for (image_t *image = cache.images; image != NULL; image = image->next_cached)
+		if (cache_key_equal(image, canonical_path, &stat_buffer))
+		{
+			cache.hits++;
+			log_message(2, "[image] Cache hit: %s\n", canonical_path);
+			free(canonical_path);
+			return image_t_reference(image);
+		}
+
+	cache.misses++;
+	log_message(2, "[image] Cache miss: %s\n", canonical_path);
+
+	image_t *image = calloc(1, sizeof(image_t));
+	if ( image == NULL )
+	{
+		log_message(0, "ERROR: Can not allocate.\n");
+		free(canonical_path);
+		return NULL;
+	}
 
+	image->path          = canonical_path;
+	image->device        = stat_buffer.st_dev;
+	image->inode         = stat_buffer.st_ino;
+	image->mtime         = stat_buffer.st_mtim;
 	image->cairo_surface = NULL;
-	image->references    = 1;
 #if SVG_SUPPORT
-	image->rsvg_handle   = NULL;
+	image->rsvg_handle    = NULL;
+	image->svg            = false;
+	image->svg_hash       = 0;
+	image->svg_hash_valid = false;
 #endif
 
-	if (load_image(image, path))
-		return image;
-	
-	free(image);
-	return NULL;
+	if (! load_image(image, canonical_path))
+	{
+		free(canonical_path);
+		free(image);
+		return NULL;
+	}
+
+	/* One reference for the caller and one for the cache. */
+	image->references  = 2;
+	image->next_cached = cache.images;
+	cache.images       = image;
+
+	return image;
 }
 
 image_t *image_t_reference (image_t *image)
@@ -173,9 +311,310 @@ void image_t_destroy (image_t *image)
 		g_object_unref(image->rsvg_handle);
 #endif
 
+	free_if_set(image->path);
 	free(image);
 }
 
+static void cache_evict (bool all)
+{
+	image_t **link = &cache.images;
+	while ( *link != NULL )
+	{
+		image_t *image = *link;
+		if ( all || image->references == 1 )
+		{
+			log_message(2, "[image] Evicting from cache: %s\n", image->path);
+			*link = image->next_cached;
+			image_t_destroy(image);
+			cache.evictions++;
+		}
+		else
+			link = &image->next_cached;
+	}
+
+	log_message(1, "[image] Cache: hits=%lu misses=%lu evictions=%lu\n",
+			cache.hits, cache.misses, cache.evictions);
+}
+
+/* Evict all images which are no longer used by any item. */
+void image_t_cache_sweep (void)
+{
+	cache_evict(false);
+}
+
+/* Drop the references of the cache to all images. */
+void image_t_cache_finish (void)
+{
+	cache_evict(true);
+}
+
+#if SVG_SUPPORT
+static bool render_svg (cairo_t *cairo, image_t *image, uint32_t width, uint32_t height)
+{
+	if (! load_svg_handle(image))
+		return false;
+
+	// TODO maybe set DPI?
+	gboolean has_width, has_height, has_viewbox;
+	RsvgLength rsvg_width, rsvg_height;
+	RsvgRectangle viewbox;
+	rsvg_handle_get_intrinsic_dimensions(image->rsvg_handle,
+			&has_width, &rsvg_width, &has_height, &rsvg_height,
+			&has_viewbox, &viewbox);
+	if ( ! has_width || ! has_height )
+		log_message(0, "ERROR: Can not render SVG image without width or height.\n");
+	else if ( rsvg_width.length == 0 || rsvg_height.length == 0 )
+		log_message(0, "ERROR: Can not render SVG image with width or height of 0.\n");
+	else if ( rsvg_width.unit != RSVG_UNIT_PX || rsvg_height.unit != RSVG_UNIT_PX )
+		log_message(0, "ERROR: Can not render SVG image whichs width or height are not defined in pixels.\n");
+	else
+	{
+		cairo_save(cairo);
+		cairo_scale(cairo, (float)width / rsvg_width.length,
+				(float)width / rsvg_height.length);
+		GError *gerror = NULL;
+		rsvg_handle_render_document(image->rsvg_handle, cairo,
+				&viewbox, &gerror);
+		// TODO check value of gerror
+		cairo_restore(cairo);
+		return true;
+	}
+
+	return false;
+}
+
+/********************
+ * SVG raster cache *
+ ********************/
+/* Rendered SVG images are stored as raw ARGB32 data following this header in
+ * $XDG_CACHE_HOME/lavalauncher. The file name contains the hash of the SVG
+ * file, the pixel size and the librsvg version, so a file is never updated,
+ * just replaced by one with a different name.
+ */
+struct Raster_header
+{
+	char     magic[8];
+	uint32_t width, height, stride, reserved;
+};
+
+static const char raster_magic[8] = { 'L', 'A', 'V', 'A', 'R', 'A', 'S', '1' };
+
+/* The FNV-1a hash of the file contents is used as key for the raster cache. It
+ * is only computed once the cache is first used for the image.
+ */
+static bool get_svg_hash (image_t *image)
+{
+	if (image->svg_hash_valid)
+		return true;
+
+	int fd = open(image->path, O_RDONLY);
+	if ( fd == -1 )
+	{
+		log_message(0, "ERROR: Can not open file: %s\n"
+				"ERROR: open: %s\n", image->path, strerror(errno));
+		return false;
+	}
+
+	struct stat stat_buffer;
+	if ( -1 == fstat(fd, &stat_buffer) )
+	{
+		log_message(0, "ERROR: fstat: %s\n", strerror(errno));
+		close(fd);
+		return false;
+	}
+
+	const size_t size = (size_t)stat_buffer.st_size;
+	image->svg_hash = 14695981039346656037ULL;
+	if ( size > 0 )
+	{
+		const unsigned char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if ( data == MAP_FAILED )
+		{
+			log_message(0, "ERROR: mmap: %s\n", strerror(errno));
+			close(fd);
+			return false;
+		}
+		for (size_t i = 0; i < size; i++)
+			image->svg_hash = (image->svg_hash ^ data[i]) * 1099511628211ULL;
+		munmap((void *)data, size);
+	}
+	close(fd);
+
+	image->svg_hash_valid = true;
+	return true;
+}
+
+static char *get_raster_cache_path (image_t *image, uint32_t width, uint32_t height)
+{
+	if (! get_svg_hash(image))
+		return NULL;
+
+	char *directory;
+	const char *xdg_cache_home = getenv("XDG_CACHE_HOME");
+	const char *home           = getenv("HOME");
+	if ( xdg_cache_home != NULL && *xdg_cache_home != '\0' )
+		directory = get_formatted_buffer("%s/lavalauncher", xdg_cache_home);
+	else if ( home != NULL )
+	{
+		char *cache_home = get_formatted_buffer("%s/.cache", home);
+		if ( cache_home == NULL )
+			return NULL;
+		if ( -1 == mkdir(cache_home, 0700) && errno != EEXIST )
+		{
+			free(cache_home);
+			return NULL;
+		}
+		free(cache_home);
+		directory = get_formatted_buffer("%s/.cache/lavalauncher", home);
+	}
+	else
+		return NULL;
+
+	if ( directory == NULL )
+		return NULL;
+	if ( -1 == mkdir(directory, 0700) && errno != EEXIST )
+	{
+		log_message(0, "ERROR: Can not create cache directory: %s\n"
+				"ERROR: mkdir: %s\n", directory, strerror(errno));
+		free(directory);
+		return NULL;
+	}
+
+	char *path = get_formatted_buffer("%s/%016" PRIx64 "-%" PRIu32 "x%" PRIu32 "-%d.%d.%d.argb",
+			directory, image->svg_hash, width, height,
+			LIBRSVG_MAJOR_VERSION, LIBRSVG_MINOR_VERSION, LIBRSVG_MICRO_VERSION);
+	free(directory);
+	return path;
+}
+
+static bool paint_raster_from_file (cairo_t *cairo, const char *path,
+		uint32_t width, uint32_t height)
+{
+	int fd = open(path, O_RDONLY);
+	if ( fd == -1 )
+		return false;
+
+	const int stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, (int)width);
+	const size_t size = sizeof(struct Raster_header) + (size_t)stride * height;
+
+	struct stat stat_buffer;
+	if ( -1 == fstat(fd, &stat_buffer) || (size_t)stat_buffer.st_size != size )
+	{
+		close(fd);
+		return false;
+	}
+
+	unsigned char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if ( data == MAP_FAILED )
+		return false;
+
+	const struct Raster_header *header = (const struct Raster_header *)data;
+	bool ret = false;
+	if ( ! memcmp(header->magic, raster_magic, sizeof(raster_magic))
+			&& header->width == width && header->height == height
+			&& header->stride == (uint32_t)stride )
+	{
+		/* Cairo only reads from a surface used as source. */
+		cairo_surface_t *surface = cairo_image_surface_create_for_data(
+				data + sizeof(struct Raster_header), CAIRO_FORMAT_ARGB32,
+				(int)width, (int)height, stride);
+		cairo_set_source_surface(cairo, surface, 0, 0);
+		cairo_paint(cairo);
+		cairo_surface_destroy(surface);
+		ret = true;
+	}
+
+	munmap(data, size);
+	return ret;
+}
+
+static void write_raster_to_file (cairo_surface_t *surface, const char *path,
+		uint32_t width, uint32_t height)
+{
+	cairo_surface_flush(surface);
+	const int stride = cairo_image_surface_get_stride(surface);
+
+	struct Raster_header header;
+	memcpy(header.magic, raster_magic, sizeof(raster_magic));
+	header.width    = width;
+	header.height   = height;
+	header.stride   = (uint32_t)stride;
+	header.reserved = 0;
+
+	/* Write to a temporary file first, so other instances of LavaLauncher
+	 * never see an incomplete file.
+	 */
+	char *temp_path = get_formatted_buffer("%s.%ld.tmp", path, (long)getpid());
+	if ( temp_path == NULL )
+		return;
+
+	FILE *file = fopen(temp_path, "w");
+	if ( file == NULL )
+	{
+		log_message(0, "ERROR: Can not open file: %s\n"
+				"ERROR: fopen: %s\n", temp_path, strerror(errno));
+		free(temp_path);
+		return;
+	}
+
+	const size_t data_size = (size_t)stride * height;
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+		&& fwrite(cairo_image_surface_get_data(surface), data_size, 1, file) == 1;
+	ok = ( fclose(file) == 0 ) && ok;
+
+	if ( ! ok || -1 == rename(temp_path, path) )
+	{
+		log_message(0, "ERROR: Can not write raster cache file: %s\n", path);
+		unlink(temp_path);
+	}
+
+	free(temp_path);
+}
+
+/* Returns false if the raster cache can not be used, in which case the image
+ * has to be rendered directly.
+ */
+static bool draw_svg_from_raster_cache (cairo_t *cairo, image_t *image,
+		uint32_t width, uint32_t height)
+{
+	char *path = get_raster_cache_path(image, width, height);
+	if ( path == NULL )
+		return false;
+
+	if (paint_raster_from_file(cairo, path, width, height))
+	{
+		log_message(2, "[image] Raster cache hit: %s\n", path);
+		free(path);
+		return true;
+	}
+
+	log_message(2, "[image] Raster cache miss: %s\n", path);
+
+	cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+			(int)width, (int)height);
+	if ( cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS )
+	{
+		cairo_surface_destroy(surface);
+		free(path);
+		return false;
+	}
+
+	cairo_t *raster_cairo = cairo_create(surface);
+	cairo_set_antialias(raster_cairo, CAIRO_ANTIALIAS_BEST);
+	if (render_svg(raster_cairo, image, width, height))
+		write_raster_to_file(surface, path, width, height);
+	cairo_destroy(raster_cairo);
+
+	cairo_set_source_surface(cairo, surface, 0, 0);
+	cairo_paint(cairo);
+
+	cairo_surface_destroy(surface);
+	free(path);
+	return true;
+}
+#endif
+
 void image_t_draw_to_cairo (cairo_t *cairo, image_t *image,
 		uint32_t x, uint32_t y, uint32_t width, uint32_t height)
 {
@@ -192,30 +631,10 @@ void image_t_draw_to_cairo (cairo_t *cairo, image_t *image,
 		cairo_paint(cairo);
 	}
 #if SVG_SUPPORT
-	else if ( image->rsvg_handle != NULL )
-	{
-		// TODO maybe set DPI?
-		gboolean has_width, has_height, has_viewbox;
-		RsvgLength rsvg_width, rsvg_height;
-		RsvgRectangle viewbox;
-		rsvg_handle_get_intrinsic_dimensions(image->rsvg_handle,
-				&has_width, &rsvg_width, &has_height, &rsvg_height,
-				&has_viewbox, &viewbox);
-		if ( ! has_width || ! has_height )
-			log_message(0, "ERROR: Can not render SVG image without width or height.\n");
-		else if ( rsvg_width.length == 0 || rsvg_height.length == 0 )
-			log_message(0, "ERROR: Can not render SVG image with width or height of 0.\n");
-		else if ( rsvg_width.unit != RSVG_UNIT_PX || rsvg_height.unit != RSVG_UNIT_PX )
-			log_message(0, "ERROR: Can not render SVG image whichs width or height are not defined in pixels.\n");
-		else
-		{
-			cairo_scale(cairo, (float)width / rsvg_width.length,
-					(float)width / rsvg_height.length);
-			GError *gerror = NULL;
-			rsvg_handle_render_document(image->rsvg_handle, cairo,
-					&viewbox, &gerror);
-			// TODO check value of gerror
-		}
+	else if ( image->svg )
+	{
+		if ( ! context.svg_cache || ! draw_svg_from_raster_cache(cairo, image, width, height) )
+			render_svg(cairo, image, width, height);
 	}
 #endif
 
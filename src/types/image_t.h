@@ -17,26 +17,44 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
-/* Ref-counted image type, combining a cairo surface and an rsvg handle. Once
- * bar copies are removed in favour of a better conditional configuration method,
- * the ref count can be removed.
+/* Ref-counted image type, combining a cairo surface and an rsvg handle. Images
+ * are cached process-wide, keyed by their canonical path, device, inode and
+ * modification time, so every file is only decoded once, even across reloads.
  */
 
 #ifndef LAVALAUNCHER_TYPES_IMAGE_H
 #define LAVALAUNCHER_TYPES_IMAGE_H
 
 #include<stdint.h>
+#include<stdbool.h>
+#include<sys/types.h>
+#include<time.h>
 #include<cairo/cairo.h>
 
 #if SVG_SUPPORT
 #include<librsvg-2.0/librsvg/rsvg.h>
 #endif
 
-typedef struct
+typedef struct image_t
 {
+	/* Canonical path of the file. */
+	char *path;
+
+	/* Cache key and cache link. */
+	dev_t            device;
+	ino_t            inode;
+	struct timespec  mtime;
+	struct image_t  *next_cached;
+
 	cairo_surface_t *cairo_surface;
 
 #if SVG_SUPPORT
+	/* The rsvg handle is only created when the image needs to be rendered,
+	 * the hash only when the raster cache is used.
+	 */
+	bool        svg;
+	bool        svg_hash_valid;
+	uint64_t    svg_hash;
 	RsvgHandle *rsvg_handle;
 #endif
 
@@ -46,6 +64,8 @@ typedef struct
 image_t *image_t_create_from_file (const char *path);
 image_t *image_t_reference (image_t *image);
 void image_t_destroy (image_t *image);
+void image_t_cache_sweep (void);
+void image_t_cache_finish (void);
 void image_t_draw_to_cairo (cairo_t *cairo, image_t *image,
 		uint32_t x, uint32_t y, uint32_t width, uint32_t height);
 
@@ -41,6 +41,7 @@
 #include"str.h"
 #include"seat.h"
 #include"output.h"
+#include"bar.h"
 #include"event-loop.h"
 
 
@@ -198,6 +199,7 @@ static void finish_wayland (void)
 
 	destroy_all_outputs();
 	destroy_all_seats();
+	destroy_cursor_themes();
 
 	log_message(2, "[registry] Destroying Wayland objects.\n");
 
@@ -221,6 +223,9 @@ static void finish_wayland (void)
  *  Wayland event source  *
  *                        *
  **************************/
+/* Whether we announced our intention to read from the display fd. */
+static bool wayland_reading = false;
+
 static bool wayland_source_init (struct pollfd *fd)
 {
 	log_message(1, "[loop] Setting up Wayland event source.\n");
@@ -228,6 +233,7 @@ static bool wayland_source_init (struct pollfd *fd)
 	if (! init_wayland())
 		return false;
 
+	wayland_reading = false;
 	fd->events = POLLIN;
 	if ( -1 == (fd->fd = wl_display_get_fd(context.display)) )
 	{
@@ -239,30 +245,74 @@ static bool wayland_source_init (struct pollfd *fd)
 
 static bool wayland_source_finish (struct pollfd *fd)
 {
+	if (wayland_reading)
+	{
+		wl_display_cancel_read(context.display);
+		wayland_reading = false;
+	}
 	if ( fd->fd != -1 )
 		close(fd->fd);
 	finish_wayland();
 	return true;
 }
 
+/* Write all pending requests to the display fd. If the socket is full, we wait
+ * until it is writable again instead of retrying.
+ */
+static bool wayland_flush_requests (struct pollfd *fd)
+{
+	if ( wl_display_flush(context.display) == -1 )
+	{
+		if ( errno != EAGAIN )
+		{
+			log_message(0, "ERROR: wl_display_flush: %s\n", strerror(errno));
+			return false;
+		}
+		fd->events = POLLIN | POLLOUT;
+	}
+	else
+		fd->events = POLLIN;
+	return true;
+}
+
 static bool wayland_source_flush (struct pollfd *fd)
 {
-	do {
-		if ( wl_display_flush(context.display) == 1 && errno != EAGAIN )
+	/* A read prepared in a previous iteration which did not result in
+	 * reading is given up, as events may have been queued since.
+	 */
+	if (wayland_reading)
+		wl_display_cancel_read(context.display);
+
+	/* Events must only be read once the queue has been dispatched. */
+	while ( wl_display_prepare_read(context.display) != 0 )
+		if ( wl_display_dispatch_pending(context.display) == -1 )
 		{
-			log_message(0, "ERROR: wl_display_flush: %s\n",
+			log_message(0, "ERROR: wl_display_dispatch_pending: %s\n",
 					strerror(errno));
-			break;
+			wayland_reading = false;
+			return false;
 		}
-	} while ( errno == EAGAIN );
-	return true;
+	wayland_reading = true;
+
+	/* All updates caused by the events of this loop iteration are done
+	 * together, so bursts of events cause only a single render.
+	 */
+	flush_bar_instance_updates();
+
+	return wayland_flush_requests(fd);
 }
 
 static bool wayland_source_handle_in (struct pollfd *fd)
 {
-	if ( wl_display_dispatch(context.display) == -1 )
+	wayland_reading = false;
+	if ( wl_display_read_events(context.display) == -1 )
 	{
-		log_message(0, "ERROR: wl_display_dispatch: %s\n", strerror(errno));
+		log_message(0, "ERROR: wl_display_read_events: %s\n", strerror(errno));
+		return false;
+	}
+	if ( wl_display_dispatch_pending(context.display) == -1 )
+	{
+		log_message(0, "ERROR: wl_display_dispatch_pending: %s\n", strerror(errno));
 		return false;
 	}
 	return true;
@@ -270,12 +320,7 @@ static bool wayland_source_handle_in (struct pollfd *fd)
 
 static bool wayland_source_handle_out (struct pollfd *fd)
 {
-	if ( wl_display_flush(context.display) == -1 )
-	{
-		log_message(0, "ERROR: wl_display_flush: %s\n", strerror(errno));
-		return false;
-	}
-	return true;
+	return wayland_flush_requests(fd);
 }
 
 struct Lava_event_source wayland_source = {
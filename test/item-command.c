@@ -0,0 +1,112 @@
+/*
+ * LavaLauncher - A simple launcher panel for Wayland
+ *
+ * Copyright (C) 2020 - 2021 Leon Henrik Plickat
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/* Checks that overwriting the command of a button also replaces the arguments
+ * and binary it is executed with.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include<stdio.h>
+#include<stdlib.h>
+#include<stdbool.h>
+#include<string.h>
+
+#include"lavalauncher.h"
+#include"bar.h"
+#include"item.h"
+
+/* Normally defined next to main() in lavalauncher.c, which is not linked in. */
+struct Lava_context context;
+
+static int failures = 0;
+
+#define CHECK(A) \
+	if (! (A)) \
+	{ \
+		fprintf(stderr, "%s:%d: Check failed: %s\n", __FILE__, __LINE__, #A); \
+		failures++; \
+	}
+
+static struct Lava_item_command *first_command (struct Lava_item *item)
+{
+	struct Lava_item_command *cmd;
+	wl_list_for_each(cmd, &item->commands, link)
+		return cmd;
+	return NULL;
+}
+
+static bool ends_with (const char *str, const char *suffix)
+{
+	if ( str == NULL )
+		return false;
+	size_t len = strlen(str), suffix_len = strlen(suffix);
+	return len >= suffix_len && ! strcmp(str + len - suffix_len, suffix);
+}
+
+/* Sets a command twice and checks that only the second one is used. */
+static void check_override (const char *variable)
+{
+	struct Lava_bar bar = { 0 };
+	wl_list_init(&bar.items);
+
+	CHECK(create_item(&bar, TYPE_BUTTON));
+	struct Lava_item *item = bar.last_item;
+
+	/* Executed directly. */
+	CHECK(item_set_variable(item, variable, "false", 1));
+	struct Lava_item_command *cmd = first_command(item);
+	CHECK( cmd != NULL && ends_with(cmd->binary, "/false") );
+
+	/* Another directly executed command. */
+	CHECK(item_set_variable(item, variable, "true --flag", 1));
+	CHECK( wl_list_length(&item->commands) == 1 );
+	cmd = first_command(item);
+	CHECK( cmd != NULL && ! strcmp(cmd->command, "true --flag") );
+	CHECK( cmd != NULL && ends_with(cmd->binary, "/true") );
+	CHECK( cmd != NULL && cmd->argv != NULL && ! strcmp(cmd->argv[0], "true")
+			&& ! strcmp(cmd->argv[1], "--flag") && cmd->argv[2] == NULL );
+
+	/* Uses shell features, so must not keep the previous arguments. */
+	CHECK(item_set_variable(item, variable, "true | cat", 1));
+	cmd = first_command(item);
+	CHECK( cmd != NULL && ! strcmp(cmd->command, "true | cat") );
+	CHECK( cmd != NULL && cmd->binary == NULL && cmd->argv == NULL );
+
+	/* A directory is not executable, even though access() says so. */
+	CHECK(item_set_variable(item, variable, "/", 1));
+	cmd = first_command(item);
+	CHECK( cmd != NULL && cmd->binary == NULL && cmd->argv == NULL );
+
+	destroy_all_items(&bar);
+}
+
+int main (void)
+{
+	check_override("command");
+	check_override("command[mouse-left]");
+
+	if ( failures > 0 )
+	{
+		fprintf(stderr, "%d checks failed.\n", failures);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}